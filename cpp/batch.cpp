@@ -0,0 +1,371 @@
+// Batch runner: runs a sweep over the model parameters without a window,
+// several models at a time, and writes one CSV line of metrics per run (and,
+// with out=<dir>, an image of every final snowflake). Build natively, e.g.
+//   g++ -std=c++17 -O3 -pthread ./cpp/batch.cpp -o batch
+//   ./batch preset=2 rho=0.4:0.8:0.1 beta=1.3,1.6,2.0 steps=20000 out=runs
+//
+// A parameter (rho beta kappa mu gamma theta alpha sigma) takes a value, a
+// list a,b,c or an inclusive range start:stop:step, and the sweep runs every
+// combination. preset=, grid= and seed= set the rest of the settings.
+// file=<path> reads further sweeps, one per line in the same key=value form
+// ('#' starts a comment); each line is expanded on its own, on top of the
+// sweep given on the command line.
+//
+// Options: steps= (step cap, default 100000), jobs= (models run at once,
+// default one per core), threads= (threads per model, default 1), out=
+// (directory for the images), summary= (CSV file, default stdout), full=1
+// to compute the whole hexagon instead of the symmetric wedge (noisy runs
+// always compute the whole hexagon) and ensemble=1 to step up to eight
+// consecutive runs that share grid, seed and symmetry together in one
+// EnsembleModel (see ensemble.h; threads= is then ignored). The results are
+// the same; an ensemble's ms is its time shared out over its members.
+#include "./src/ensemble.h"
+#include "./src/presets.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using Spec = std::vector<std::pair<std::string, std::string>>;
+
+const std::pair<const char*, float ModelSettings::*> PARAMETERS[] = {
+    {"rho", &ModelSettings::rho}, {"beta", &ModelSettings::beta}, {"kappa", &ModelSettings::kappa},
+    {"mu", &ModelSettings::mu}, {"gamma", &ModelSettings::gamma}, {"theta", &ModelSettings::theta},
+    {"alpha", &ModelSettings::alpha}, {"sigma", &ModelSettings::sigma}
+};
+
+[[noreturn]] void fail(const std::string& message) {
+    std::fprintf(stderr, "batch: %s\n", message.c_str());
+    std::exit(1);
+}
+
+float parseNumber(const std::string& text) {
+    char* end = nullptr;
+    const float value = std::strtof(text.c_str(), &end);
+    if (text.empty() || *end != '\0') fail("not a number: " + text);
+    return value;
+}
+
+// "v", "a,b,c" or "start:stop:step" (stop included)
+std::vector<float> parseValues(const std::string& text) {
+    std::vector<float> values;
+    const size_t colon = text.find(':');
+    if (colon != std::string::npos) {
+        const size_t second = text.find(':', colon + 1);
+        if (second == std::string::npos) fail("range needs start:stop:step: " + text);
+        const float start = parseNumber(text.substr(0, colon));
+        const float stop = parseNumber(text.substr(colon + 1, second - colon - 1));
+        const float step = parseNumber(text.substr(second + 1));
+        if (!(step > 0.0f) || stop < start) fail("empty range: " + text);
+        const int count = static_cast<int>(std::floor((stop - start) / step + 1e-4f)) + 1;
+        for (int k = 0; k < count; ++k) {
+            values.push_back(start + k * step);
+        }
+        return values;
+    }
+
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        values.push_back(parseNumber(item));
+    }
+    if (values.empty()) fail("no values: " + text);
+    return values;
+}
+
+float ModelSettings::* findParameter(const std::string& name) {
+    for (auto& [key, member] : PARAMETERS) {
+        if (name == key) return member;
+    }
+    return nullptr;
+}
+
+// Every combination of the parameter values in spec, the first parameter
+// varying slowest
+void expand(const Spec& spec, std::vector<ModelSettings>& runs) {
+    int preset = 0;
+    for (auto& [key, value] : spec) {
+        if (key == "preset") preset = static_cast<int>(parseNumber(value));
+    }
+    if (preset < 0 || preset >= static_cast<int>(getPresetCount())) fail("no preset " + std::to_string(preset));
+
+    ModelSettings base = getPreset(preset).settings;
+    std::vector<std::pair<float ModelSettings::*, std::vector<float>>> axes;
+    for (auto& [key, value] : spec) {
+        if (key == "preset") continue;
+        if (key == "grid") {
+            base.gridSize = static_cast<int>(parseNumber(value));
+        } else if (key == "seed") {
+            base.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (auto member = findParameter(key)) {
+            axes.push_back({member, parseValues(value)});
+        } else {
+            fail("unknown parameter " + key);
+        }
+    }
+
+    std::vector<size_t> index(axes.size(), 0);
+    while (true) {
+        ModelSettings settings = base;
+        for (size_t a = 0; a < axes.size(); ++a) {
+            settings.*axes[a].first = axes[a].second[index[a]];
+        }
+        runs.push_back(settings);
+
+        // Odometer over the axes, last one fastest
+        size_t a = axes.size();
+        while (a > 0 && ++index[a - 1] == axes[a - 1].second.size()) {
+            index[--a] = 0;
+        }
+        if (a == 0) return;
+    }
+}
+
+// Later entries override earlier ones with the same key
+void set(Spec& spec, const std::string& key, const std::string& value) {
+    for (auto& entry : spec) {
+        if (entry.first == key) {
+            entry.second = value;
+            return;
+        }
+    }
+    spec.push_back({key, value});
+}
+
+bool parseToken(const std::string& token, std::string& key, std::string& value) {
+    const size_t equals = token.find('=');
+    if (equals == std::string::npos) return false;
+    key = token.substr(0, equals);
+    value = token.substr(equals + 1);
+    return true;
+}
+
+struct Metrics {
+    int steps;
+    bool reachedBoundary;
+    int crystalSites;
+    double crystalMass;
+    Extent extent;
+    double milliseconds;
+};
+
+// Grayscale image of the snowflake: crystal by its mass, vapor dimmer. Each
+// pixel shows the nearest cell, like the visualizer with one pixel per cell.
+void writeImage(const std::string& path, const Grid& grid, int N) {
+    const float mid = N / 2;
+    const float rowSpacing = std::sqrt(3.0f) / 2.0f;
+    const int height = static_cast<int>(std::ceil(N * rowSpacing));
+
+    std::vector<unsigned char> pixels(static_cast<size_t>(N) * height, 0);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < N; ++x) {
+            const float rowF = mid + (y - height / 2.0f) / rowSpacing;
+            const int i = static_cast<int>(std::lround(rowF));
+            const int j = static_cast<int>(std::lround(x + (i - mid) * 0.5f));
+            if (!grid.domain.contains(i, j)) continue;
+            const float level = grid.isCrystalAt(i, j) ? 96.0f + 159.0f * std::min(grid.crystalMassAt(i, j) / 3.0f, 1.0f)
+                                                       : 80.0f * std::min(grid.diffusiveMassAt(i, j), 1.0f);
+            pixels[static_cast<size_t>(y) * N + x] = static_cast<unsigned char>(level);
+        }
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    out << "P5\n" << N << " " << height << "\n255\n";
+    out.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+}
+
+// Fills in the crystal metrics of a finished model and writes its image
+void measure(BasicModel<Grid>& model, Metrics& metrics, const std::string& image) {
+    metrics.reachedBoundary = model.hasReachedBoundary();
+    metrics.extent = model.getCrystalExtent();
+
+    model.syncFarField();
+    const Grid& grid = model.fullGrid();
+    for (int i = 0; i < grid.domain.rows(); ++i) {
+        for (int j = grid.domain[i].begin; j < grid.domain[i].end; ++j) {
+            if (grid.isCrystalAt(i, j)) {
+                metrics.crystalSites++;
+                metrics.crystalMass += grid.crystalMassAt(i, j);
+            }
+        }
+    }
+    if (!image.empty()) {
+        writeImage(image, grid, model.getSettings().gridSize);
+    }
+}
+
+Metrics run(ModelSettings settings, int stepCap, const std::string& image) {
+    const auto start = std::chrono::steady_clock::now();
+    BasicModel<Grid> model(settings);
+    Metrics metrics = {0, false, 0, 0.0, {}, 0.0};
+    for (; metrics.steps < stepCap && !model.hasReachedBoundary(); ++metrics.steps) {
+        model.time_step();
+    }
+    measure(model, metrics, image);
+    metrics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return metrics;
+}
+
+constexpr int ENSEMBLE_LANES = 8;
+
+// Runs the members together, each until it reaches the boundary or the step cap
+std::vector<Metrics> runEnsemble(const std::vector<ModelSettings>& members, int stepCap,
+                                 const std::vector<std::string>& images) {
+    const auto start = std::chrono::steady_clock::now();
+    EnsembleModel<ENSEMBLE_LANES> ensemble(members);
+    while (true) {
+        for (int k = 0; k < ensemble.size(); ++k) {
+            if (ensemble.isLive(k) && ensemble.steps(k) >= static_cast<uint64_t>(stepCap)) ensemble.retire(k);
+        }
+        if (ensemble.liveCount() == 0) break;
+        ensemble.time_step();
+    }
+
+    std::vector<Metrics> metrics(members.size(), Metrics{0, false, 0, 0.0, {}, 0.0});
+    for (int k = 0; k < ensemble.size(); ++k) {
+        ModelSettings settings = ensemble.getSettings(k);
+        BasicModel<Grid> model(settings);
+        ensemble.exportMember(k, model);
+        metrics[k].steps = static_cast<int>(ensemble.steps(k));
+        measure(model, metrics[k], images[k]);
+    }
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (Metrics& m : metrics) {
+        m.milliseconds = milliseconds / members.size();
+    }
+    return metrics;
+}
+
+// Whether two runs can share an ensemble
+bool compatible(const ModelSettings& a, const ModelSettings& b) {
+    return a.gridSize == b.gridSize && a.seed == b.seed && a.useSymmetry == b.useSymmetry &&
+           a.hexDomain == b.hexDomain && a.boundaryMargin == b.boundaryMargin && a.vaporHalo == 0 && b.vaporHalo == 0;
+}
+
+int main(int argc, char** argv)
+{
+    int stepCap = 100000;
+    int jobs = std::max(1u, std::thread::hardware_concurrency());
+    int threads = 1;
+    bool full = false, ensemble = false;
+    std::string outDirectory, summaryPath, sweepFile;
+    Spec commandLine;
+
+    for (int k = 1; k < argc; ++k) {
+        std::string key, value;
+        if (!parseToken(argv[k], key, value)) fail(std::string("expected key=value, got ") + argv[k]);
+        if (key == "steps") stepCap = static_cast<int>(parseNumber(value));
+        else if (key == "jobs") jobs = std::max(1, static_cast<int>(parseNumber(value)));
+        else if (key == "threads") threads = std::max(1, static_cast<int>(parseNumber(value)));
+        else if (key == "full") full = parseNumber(value) != 0.0f;
+        else if (key == "ensemble") ensemble = parseNumber(value) != 0.0f;
+        else if (key == "out") outDirectory = value;
+        else if (key == "summary") summaryPath = value;
+        else if (key == "file") sweepFile = value;
+        else set(commandLine, key, value);
+    }
+
+    std::vector<ModelSettings> runs;
+    if (sweepFile.empty()) {
+        expand(commandLine, runs);
+    } else {
+        std::ifstream file(sweepFile);
+        if (!file) fail("can't read " + sweepFile);
+        std::string line;
+        while (std::getline(file, line)) {
+            line = line.substr(0, line.find('#'));
+            std::stringstream tokens(line);
+            Spec spec = commandLine;
+            std::string token, key, value;
+            bool any = false;
+            while (tokens >> token) {
+                if (!parseToken(token, key, value)) fail("expected key=value in " + sweepFile + ", got " + token);
+                set(spec, key, value);
+                any = true;
+            }
+            if (any) expand(spec, runs);
+        }
+    }
+
+    for (ModelSettings& settings : runs) {
+        settings.fusedStep = true;
+        settings.hexDomain = true;
+        settings.useSymmetry = !full && settings.sigma == 0.0f;
+        settings.threads = threads;
+    }
+
+    // Runs [groups[g], groups[g + 1]) go together: single runs, or with
+    // ensemble=1 up to ENSEMBLE_LANES consecutive compatible ones
+    std::vector<size_t> groups = {0};
+    for (size_t k = 1; k <= runs.size(); ++k) {
+        const size_t first = groups.back();
+        if (k == runs.size() || !ensemble || k - first == ENSEMBLE_LANES || !compatible(runs[first], runs[k])) {
+            groups.push_back(k);
+        }
+    }
+
+    if (!outDirectory.empty()) {
+        std::filesystem::create_directories(outDirectory);
+    }
+    FILE* summary = summaryPath.empty() ? stdout : std::fopen(summaryPath.c_str(), "w");
+    if (!summary) fail("can't write " + summaryPath);
+    std::fprintf(summary, "run,grid,rho,beta,kappa,mu,gamma,theta,alpha,sigma,steps,boundary,"
+                          "crystal_sites,crystal_mass,extent_rows,extent_cols,ms\n");
+
+    // Each worker takes the next group until there are none left. Lines are
+    // written as groups finish, so a long sweep can be followed as it goes.
+    std::atomic<size_t> next{0};
+    std::mutex outputMutex;
+    auto worker = [&]() {
+        for (size_t g = next++; g + 1 < groups.size(); g = next++) {
+            const std::vector<ModelSettings> members(runs.begin() + groups[g], runs.begin() + groups[g + 1]);
+            std::vector<std::string> images;
+            for (size_t k = groups[g]; k < groups[g + 1]; ++k) {
+                char image[64] = "";
+                if (!outDirectory.empty()) {
+                    std::snprintf(image, sizeof(image), "/run_%06zu.pgm", k);
+                }
+                images.push_back(image[0] ? outDirectory + image : "");
+            }
+            const std::vector<Metrics> metrics = members.size() == 1 ? std::vector<Metrics>{run(members[0], stepCap, images[0])}
+                                                                     : runEnsemble(members, stepCap, images);
+
+            std::lock_guard<std::mutex> lock(outputMutex);
+            for (size_t m = 0; m < members.size(); ++m) {
+                const ModelSettings& settings = members[m];
+                const Metrics& r = metrics[m];
+                std::fprintf(summary, "%zu,%d,%g,%g,%g,%g,%g,%g,%g,%g,%d,%d,%d,%.6f,%d,%d,%.1f\n",
+                             groups[g] + m, settings.gridSize, settings.rho, settings.beta, settings.kappa, settings.mu,
+                             settings.gamma, settings.theta, settings.alpha, settings.sigma,
+                             r.steps, r.reachedBoundary ? 1 : 0, r.crystalSites, r.crystalMass,
+                             r.extent.maxRow - r.extent.minRow + 1, r.extent.maxCol - r.extent.minCol + 1,
+                             r.milliseconds);
+            }
+            std::fflush(summary);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int k = 1; k < std::min<int>(jobs, static_cast<int>(groups.size() - 1)); ++k) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    if (summary != stdout) {
+        std::fclose(summary);
+    }
+    return 0;
+}
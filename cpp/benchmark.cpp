@@ -0,0 +1,307 @@
+// Benchmark: times every preset at several grid sizes, phase by phase, and
+// writes the results as JSON. Given a stored baseline it flags regressions
+// and exits with status 1. Build natively, with the phase timers on:
+//   g++ -std=c++17 -O3 -pthread -DGG_PHASE_TIMING ./cpp/benchmark.cpp -o benchmark
+//   ./benchmark out=baseline.json
+//   ./benchmark compare=baseline.json tolerance=0.1
+// Options: sizes= (list, default 256,512,1024,2048,4096), presets= (list of
+// indices, default all), steps= (timed steps, default 200), warmup= (steps
+// before timing, default 200), threads= (default 1), fused=1 (the fused
+// step; diffusion then includes freezing), coarse= (block size of a
+// MultiresModel's far field, see multires.h; default 0, a plain model),
+// out= (JSON file, default stdout), compare= (baseline JSON) and
+// tolerance= (allowed slowdown, default 0.1).
+//
+// Every run starts from the preset's initial state, so runs are repeatable.
+// ns/cell is the time_step time per step and per cell of the grid's domain
+// (the hexagon for hexagonal and symmetric presets). Peak RSS is
+// the high-water mark while the run's model exists where Linux lets us
+// reset it, otherwise the process' peak so far (sizes run in order). With
+// coarse= the domain is the square and the phase times are the patch's.
+#include "./src/gg_model.h"
+#include "./src/multires.h"
+#include "./src/presets.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#ifndef GG_PHASE_TIMING
+#warning "benchmark without -DGG_PHASE_TIMING reports no phase times"
+#endif
+
+#if defined(GG_PACKED_LAYOUT)
+const char* LAYOUT = "PackedGrid";
+#elif defined(GG_HALF_MASS)
+const char* LAYOUT = "CompactGrid<HalfPrecision>";
+#elif defined(GG_FIXED_MASS)
+const char* LAYOUT = "CompactGrid<FixedPrecision>";
+#elif defined(GG_TILED_GRID)
+const char* LAYOUT = "TiledGrid";
+#else
+const char* LAYOUT = "Grid";
+#endif
+
+struct Result {
+    int preset;
+    int grid;
+    int steps;              // Timed steps actually taken
+    double stepsPerSecond;
+    double nsPerCell;
+    long peakRssKb;
+    double phaseMs[static_cast<int>(Phase::COUNT)];     // Per step
+    double stepMs;                                      // Per step
+};
+
+[[noreturn]] void fail(const std::string& message) {
+    std::fprintf(stderr, "benchmark: %s\n", message.c_str());
+    std::exit(2);
+}
+
+std::vector<int> parseList(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        values.push_back(std::atoi(item.c_str()));
+    }
+    if (values.empty()) fail("empty list: " + text);
+    return values;
+}
+
+// Starts a new high-water mark for the resident set where Linux allows it
+void resetPeakRss() {
+    if (FILE* file = std::fopen("/proc/self/clear_refs", "w")) {
+        std::fputs("5", file);
+        std::fclose(file);
+    }
+}
+
+long peakRssKb() {
+    if (FILE* file = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        long kb = -1;
+        while (std::fgets(line, sizeof(line), file)) {
+            if (std::sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+        }
+        std::fclose(file);
+        if (kb >= 0) return kb;
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+// The model whose phase timers run
+Model& stepped(Model& model) { return model; }
+Model& stepped(MultiresModel<Model>& model) { return model.patch(); }
+
+template <typename M>
+Result timeSteps(M& model, double cells, int warmup, int steps) {
+    for (int k = 0; k < warmup && !model.hasReachedBoundary(); ++k) {
+        model.time_step();
+    }
+
+    stepped(model).phaseTimes.reset();
+    double seconds = 0.0;
+    int taken = 0;
+    for (; taken < steps && !model.hasReachedBoundary(); ++taken) {
+        const auto start = std::chrono::steady_clock::now();
+        model.time_step();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    Result result = {};
+    result.steps = taken;
+    const double perStep = taken > 0 ? 1.0 / taken : 0.0;
+    result.stepsPerSecond = seconds > 0.0 ? taken / seconds : 0.0;
+    result.nsPerCell = seconds * 1e9 * perStep / cells;
+    result.stepMs = seconds * 1e3 * perStep;
+    for (int p = 0; p < static_cast<int>(Phase::COUNT); ++p) {
+        result.phaseMs[p] = stepped(model).phaseTimes.seconds[p] * 1e3 * perStep;
+    }
+    result.peakRssKb = peakRssKb();
+    return result;
+}
+
+Result run(int preset, int gridSize, int warmup, int steps, int threads, bool fused, int coarse) {
+    ModelSettings settings = getPreset(preset).settings;
+    settings.gridSize = gridSize;
+    settings.fusedStep = fused;
+    settings.threads = threads;
+
+    resetPeakRss();
+    Result result;
+    if (coarse > 0) {
+        MultiresModel<Model> model(settings, coarse);
+        result = timeSteps(model, static_cast<double>(model.gridSize()) * model.gridSize(), warmup, steps);
+    } else {
+        const Domain domain = gridDomain(settings);
+        double cells = 0.0;
+        for (int i = 0; i < domain.rows(); ++i) {
+            cells += domain[i].end - domain[i].begin;
+        }
+        Model model(settings);
+        result = timeSteps(model, cells, warmup, steps);
+    }
+    result.preset = preset;
+    result.grid = gridSize;
+    return result;
+}
+
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// One result per line, so that compare can read it back without a JSON library
+std::string toJson(const Result& r) {
+    char buffer[256];
+    std::string line = "    {\"preset\": " + std::to_string(r.preset) +
+                       ", \"name\": " + jsonString(getPreset(r.preset).name) +
+                       ", \"grid\": " + std::to_string(r.grid) + ", \"steps\": " + std::to_string(r.steps);
+    std::snprintf(buffer, sizeof(buffer), ", \"steps_per_second\": %.3f, \"ns_per_cell\": %.4f, \"peak_rss_kb\": %ld",
+                  r.stepsPerSecond, r.nsPerCell, r.peakRssKb);
+    line += buffer;
+    line += ", \"ms_per_step\": {";
+    for (int p = 0; p < static_cast<int>(Phase::COUNT); ++p) {
+        std::snprintf(buffer, sizeof(buffer), "\"%s\": %.5f, ", PHASE_NAMES[p], r.phaseMs[p]);
+        line += buffer;
+    }
+    std::snprintf(buffer, sizeof(buffer), "\"time_step\": %.5f}}", r.stepMs);
+    return line + buffer;
+}
+
+// The number after "key": on a result line, or -1
+double field(const std::string& line, const std::string& key) {
+    const size_t at = line.find("\"" + key + "\":");
+    return at == std::string::npos ? -1.0 : std::atof(line.c_str() + at + key.size() + 3);
+}
+
+// Compares against a file written by this program; returns the number of
+// regressions. Phases under 0.01 ms per step are too short to judge.
+int compare(const std::vector<Result>& results, const std::string& path, double tolerance) {
+    std::ifstream file(path);
+    if (!file) fail("can't read " + path);
+    std::map<std::pair<int, int>, std::string> baseline;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.find("\"preset\":") == std::string::npos) continue;
+        baseline[{static_cast<int>(field(line, "preset")), static_cast<int>(field(line, "grid"))}] = line;
+    }
+
+    int regressions = 0;
+    for (auto& r : results) {
+        auto found = baseline.find({r.preset, r.grid});
+        if (found == baseline.end()) {
+            std::fprintf(stderr, "preset %d grid %d: not in the baseline\n", r.preset, r.grid);
+            continue;
+        }
+        const std::string& old = found->second;
+        auto check = [&](const char* what, double before, double now, bool higherIsBetter) {
+            if (before <= 0.0 || (!higherIsBetter && before < 0.01 && now < 0.01)) return;
+            const double change = higherIsBetter ? before / std::max(now, 1e-12) - 1.0 : now / before - 1.0;
+            const bool regressed = change > tolerance;
+            regressions += regressed;
+            std::fprintf(stderr, "preset %d grid %5d %-22s %12.4f -> %12.4f  %+6.1f%%%s\n",
+                         r.preset, r.grid, what, before, now,
+                         100.0 * (now / before - 1.0), regressed ? "  REGRESSION" : "");
+        };
+        check("steps_per_second", field(old, "steps_per_second"), r.stepsPerSecond, true);
+        for (int p = 0; p < static_cast<int>(Phase::COUNT); ++p) {
+            check(PHASE_NAMES[p], field(old, PHASE_NAMES[p]), r.phaseMs[p], false);
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int> sizes = {256, 512, 1024, 2048, 4096};
+    std::vector<int> presets;
+    int steps = 200, warmup = 200, threads = 1, coarse = 0;
+    bool fused = false;
+    double tolerance = 0.1;
+    std::string outPath, comparePath;
+
+    for (int k = 1; k < argc; ++k) {
+        const char* equals = std::strchr(argv[k], '=');
+        if (!equals) fail(std::string("expected key=value, got ") + argv[k]);
+        const std::string key(argv[k], equals - argv[k]);
+        const std::string value = equals + 1;
+        if (key == "sizes") sizes = parseList(value);
+        else if (key == "presets") presets = parseList(value);
+        else if (key == "steps") steps = std::max(1, std::atoi(value.c_str()));
+        else if (key == "warmup") warmup = std::max(0, std::atoi(value.c_str()));
+        else if (key == "threads") threads = std::max(1, std::atoi(value.c_str()));
+        else if (key == "fused") fused = std::atoi(value.c_str()) != 0;
+        else if (key == "coarse") coarse = std::max(0, std::atoi(value.c_str()));
+        else if (key == "out") outPath = value;
+        else if (key == "compare") comparePath = value;
+        else if (key == "tolerance") tolerance = std::atof(value.c_str());
+        else fail("unknown option " + key);
+    }
+    if (presets.empty()) {
+        for (int p = 0; p < static_cast<int>(getPresetCount()); ++p) presets.push_back(p);
+    }
+    for (int p : presets) {
+        if (p < 0 || p >= static_cast<int>(getPresetCount())) fail("no preset " + std::to_string(p));
+    }
+    std::sort(sizes.begin(), sizes.end());
+
+    std::vector<Result> results;
+    for (int size : sizes) {
+        for (int p : presets) {
+            results.push_back(run(p, size, warmup, steps, threads, fused, coarse));
+            const Result& r = results.back();
+            std::fprintf(stderr, "preset %d grid %5d: %9.1f steps/s, %7.3f ns/cell, %8ld kB\n",
+                         p, size, r.stepsPerSecond, r.nsPerCell, r.peakRssKb);
+        }
+    }
+
+    std::string json = "{\n  \"layout\": " + jsonString(LAYOUT) + ",\n  \"fused\": " + (fused ? "true" : "false") +
+                       ",\n  \"threads\": " + std::to_string(threads) + ",\n  \"coarse\": " + std::to_string(coarse) + ",\n  \"warmup\": " + std::to_string(warmup) +
+                       ",\n  \"steps\": " + std::to_string(steps) +
+#ifdef __VERSION__
+                       ",\n  \"compiler\": " + jsonString(__VERSION__) +
+#endif
+                       ",\n  \"results\": [\n";
+    for (size_t k = 0; k < results.size(); ++k) {
+        json += toJson(results[k]) + (k + 1 < results.size() ? ",\n" : "\n");
+    }
+    json += "  ]\n}\n";
+
+    if (outPath.empty()) {
+        std::fputs(json.c_str(), stdout);
+    } else {
+        std::ofstream(outPath) << json;
+    }
+
+    if (!comparePath.empty()) {
+        const int regressions = compare(results, comparePath, tolerance);
+        std::fprintf(stderr, "%d regression%s beyond %.0f%%\n", regressions, regressions == 1 ? "" : "s", 100.0 * tolerance);
+        return regressions > 0 ? 1 : 0;
+    }
+    return 0;
+}
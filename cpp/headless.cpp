@@ -0,0 +1,67 @@
+// Headless driver: runs one preset without a window and prints a checksum of
+// the final state. Runs natively or under Node (threaded wasm build), e.g.
+//   node headless.js <preset> <steps> <threads> [symmetric] [sigma]
+// The checksum must not depend on the thread count, nor (without noise) on
+// whether only the symmetric wedge is computed.
+#include "./src/gg_model.h"
+#include "./src/presets.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// FNV-1a over the crystal flags and the bits of every mass
+uint64_t checksum(Model& model, int N)
+{
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t k = 0; k < size; ++k) {
+            hash = (hash ^ bytes[k]) * 1099511628211ull;
+        }
+    };
+
+    model.syncFarField();
+    const auto& grid = model.fullGrid();
+    for (int i = 0; i < N; ++i) {
+        for (int j = grid.domain[i].begin; j < grid.domain[i].end; ++j) {
+            const unsigned char crystal = grid.isCrystalAt(i, j);
+            const float masses[3] = {
+                grid.boundaryMassAt(i, j),
+                grid.crystalMassAt(i, j),
+                grid.diffusiveMassAt(i, j)
+            };
+            mix(&crystal, sizeof(crystal));
+            mix(masses, sizeof(masses));
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char** argv)
+{
+    const int presetIndex = argc > 1 ? std::atoi(argv[1]) : 0;
+    const int steps = argc > 2 ? std::atoi(argv[2]) : 1000;
+    const int threads = argc > 3 ? std::atoi(argv[3]) : 1;
+    const bool symmetric = argc > 4 && std::atoi(argv[4]) != 0;
+    const float sigma = argc > 5 ? std::atof(argv[5]) : 0.0f;
+
+    ModelSettings settings = getPreset(presetIndex).settings;
+    settings.fusedStep = true;
+    settings.hexDomain = true;
+    settings.threads = threads;
+    settings.useSymmetry = symmetric;
+    settings.sigma = sigma;
+    Model model(settings);
+
+    int step = 0;
+    for (; step < steps && !model.hasReachedBoundary(); ++step) {
+        model.time_step();
+    }
+
+    const Extent& extent = model.getCrystalExtent();
+    std::printf("preset=%d steps=%d extent=%d..%d,%d..%d checksum=%016llx\n",
+                presetIndex, step, extent.minRow, extent.maxRow, extent.minCol, extent.maxCol,
+                static_cast<unsigned long long>(checksum(model, settings.gridSize)));
+    return 0;
+}
@@ -5,19 +5,121 @@
 #include <SDL3/SDL_hints.h>
 #include <SDL3/SDL_events.h>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #include <emscripten/html5.h>
 #include <emscripten/bind.h>
+#else
+#include "./vis/frame_export.h"
+#endif
+
+// Threaded wasm builds advance the model on its own thread and only render
+// on the browser thread. Define it for native builds to do the same there.
+#ifdef __EMSCRIPTEN_PTHREADS__
+#define GG_SIMULATION_THREAD 1
 #endif
 
 ModelSettings *settings;
 Model *model;
 Visualizer *visualizer;
 int iterationsPerFrame = 1;
-int current_iteration = 0;
+float frameBudgetMs = 0.0f;     // When > 0, step for this long per frame instead
 SDL_Event event;
 
+// Steps per second, measured over windows of about half a second
+using Clock = std::chrono::steady_clock;
+std::atomic<long long> stepsTaken{0};
+long long stepsAtLastSample = 0;
+Clock::time_point lastSample = Clock::now();
+float stepsPerSecond = 0.0f;
+
+void update_step_rate()
+{
+    const auto now = Clock::now();
+    const float seconds = std::chrono::duration<float>(now - lastSample).count();
+    if (seconds >= 0.5f) {
+        const long long steps = stepsTaken;
+        stepsPerSecond = (steps - stepsAtLastSample) / seconds;
+        stepsAtLastSample = steps;
+        lastSample = now;
+    }
+}
+
+// Guards the model, settings and visualizer against the simulation thread
+std::recursive_mutex modelMutex;
+
+#ifndef __EMSCRIPTEN__
+// Native builds can also write frames while they run (see main)
+FrameExporter* exporter = nullptr;
+long long exportEvery = 100;
+// and, built with -DGG_TRACE, stream the step and frame records to a file
+TraceFile* traceFile = nullptr;
+#endif
+
+// One step, and every exportEvery steps a frame for the exporter
+void step_model()
+{
+    model->time_step();
+    stepsTaken++;
+    #ifndef __EMSCRIPTEN__
+    const uint64_t step = model->progress().steps;
+    if (exporter && step % exportEvery == 0) {
+        model->syncFarField();
+        exporter->capture(model->fullGrid(), step);
+    }
+    #endif
+}
+
+// Writes the frames and trace records still waiting, before the program exits
+void finish_output()
+{
+    #ifndef __EMSCRIPTEN__
+    std::lock_guard<std::recursive_mutex> lock(modelMutex);
+    delete exporter;
+    exporter = nullptr;
+    if (traceFile) {
+        traceFile->append(model->stepTrace, visualizer->frameTrace);
+        delete traceFile;
+        traceFile = nullptr;
+    }
+    #endif
+}
+
+#ifdef GG_SIMULATION_THREAD
+std::atomic<bool> simulationPaused{false};
+std::atomic<bool> renderPending{false};
+
+void simulation_loop()
+{
+    while (true) {
+        // Let a waiting frame in between steps
+        while (renderPending || simulationPaused) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+
+        bool finished;
+        {
+            std::lock_guard<std::recursive_mutex> lock(modelMutex);
+            finished = model->hasReachedBoundary();
+            if (!finished) {
+                step_model();
+            }
+        }
+
+        // Nothing to do until a reset or a new preset
+        if (finished) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+#endif
+
 
 void main_loop()
 {
@@ -25,6 +127,7 @@ void main_loop()
     while (SDL_PollEvent(&event)) {
         #ifndef __EMSCRIPTEN__
         if (event.type == SDL_EVENT_QUIT) {
+            finish_output();
             exit(0);
         }
         #endif
@@ -33,14 +136,40 @@ void main_loop()
         }
     }
 
-    // Advance model
-    model->time_step();
-    current_iteration++;
-    if (current_iteration >= iterationsPerFrame)
-    {
-        current_iteration = 0;
-        visualizer->draw(model->snowflake);
+    #ifdef GG_SIMULATION_THREAD
+    // The simulation thread advances the model, this thread only renders
+    renderPending = true;
+    std::lock_guard<std::recursive_mutex> lock(modelMutex);
+    renderPending = false;
+    model->syncFarField();
+    visualizer->draw(model->fullGrid(), model->activeExtent());
+    #else
+    // Advance the model by a batch of steps, or for as long as the frame
+    // budget allows, then render once
+    const auto frameStart = Clock::now();
+    int steps = 0;
+    while (!model->hasReachedBoundary()) {
+        step_model();
+        steps++;
+
+        if (frameBudgetMs > 0.0f) {
+            if (std::chrono::duration<float, std::milli>(Clock::now() - frameStart).count() >= frameBudgetMs) break;
+        } else if (steps >= iterationsPerFrame) {
+            break;
+        }
     }
+
+    model->syncFarField();
+    visualizer->draw(model->fullGrid(), model->activeExtent());
+    #endif
+
+    #ifndef __EMSCRIPTEN__
+    if (traceFile) {
+        traceFile->append(model->stepTrace, visualizer->frameTrace);
+    }
+    #endif
+
+    update_step_rate();
 }
 
 void init()
@@ -59,13 +188,23 @@ void init()
     settings->theta = 0.025f;
     settings->sigma = 0.0f;
     settings->alpha = 0.4f;
+    settings->fusedStep = true;
+    settings->hexDomain = true;
+    #if !defined(__EMSCRIPTEN__) || defined(GG_SIMULATION_THREAD)
+    settings->threads = std::max(1u, std::thread::hardware_concurrency());
+    #endif
 
     model = new Model(*settings);
     visualizer = new Visualizer(*settings, 1000);
+
+    #ifdef GG_SIMULATION_THREAD
+    std::thread(simulation_loop).detach();
+    #endif
 }
 
 void reset()
 {
+    std::lock_guard<std::recursive_mutex> lock(modelMutex);
     model->initialize();
 }
 
@@ -75,7 +214,10 @@ void set_window_size(int size)
     emscripten_cancel_main_loop();
     #endif
     
-    visualizer->resizeWindow(size);
+    {
+        std::lock_guard<std::recursive_mutex> lock(modelMutex);
+        visualizer->resizeWindow(size);
+    }
     
     #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop(main_loop, 0, 1);
@@ -88,9 +230,12 @@ void set_grid_size(int size)
     emscripten_cancel_main_loop();
     #endif
     
-    visualizer->resizeGrid(size);
-    delete model;
-    model = new Model(*settings);
+    {
+        std::lock_guard<std::recursive_mutex> lock(modelMutex);
+        visualizer->resizeGrid(size);
+        delete model;
+        model = new Model(*settings);
+    }
     
     #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop(main_loop, 0, 1);
@@ -98,13 +243,15 @@ void set_grid_size(int size)
 }
 
 
-void set_beta(float beta) { settings->beta = beta; }
-void set_rho(float rho) { settings->rho = rho; }
-void set_theta(float theta) { settings->theta = theta; }
-void set_alpha(float alpha) { settings->alpha = alpha; }
-void set_mu(float mu) { settings->mu = mu; }
-void set_kappa(float kappa) { settings->kappa = kappa; }
+void set_beta(float beta) { std::lock_guard<std::recursive_mutex> lock(modelMutex); settings->beta = beta; }
+void set_rho(float rho) { std::lock_guard<std::recursive_mutex> lock(modelMutex); settings->rho = rho; }
+void set_theta(float theta) { std::lock_guard<std::recursive_mutex> lock(modelMutex); settings->theta = theta; }
+void set_alpha(float alpha) { std::lock_guard<std::recursive_mutex> lock(modelMutex); settings->alpha = alpha; }
+void set_mu(float mu) { std::lock_guard<std::recursive_mutex> lock(modelMutex); settings->mu = mu; }
+void set_kappa(float kappa) { std::lock_guard<std::recursive_mutex> lock(modelMutex); settings->kappa = kappa; }
+void set_sigma(float sigma) { std::lock_guard<std::recursive_mutex> lock(modelMutex); settings->sigma = sigma; }
 void set_iterations_per_frame(int iterations) { iterationsPerFrame = iterations; }
+void set_frame_budget(float ms) { frameBudgetMs = ms; }
 
 float get_current_alpha() { return settings->alpha; }
 float get_current_beta() { return settings->beta; }
@@ -113,7 +260,48 @@ float get_current_kappa() { return settings->kappa; }
 float get_current_rho() { return settings->rho; }
 float get_current_theta() { return settings->theta; }
 float get_current_gamma() { return settings->gamma; }
+float get_current_sigma() { return settings->sigma; }
 int get_current_grid_size() { return settings->gridSize; }
+float get_steps_per_second() { return stepsPerSecond; }
+
+// Instrumentation (built with -DGG_TRACE, see trace.h): means over the last
+// count steps or frames, in ms where they are times
+bool get_trace_enabled()
+{
+    #ifdef GG_TRACE
+    return true;
+    #else
+    return false;
+    #endif
+}
+int get_phase_count() { return static_cast<int>(Phase::COUNT); }
+std::string get_phase_name(int phase) { return phase >= 0 && phase < get_phase_count() ? PHASE_NAMES[phase] : ""; }
+float get_trace_phase_ms(int phase, int count)
+{
+    if (phase < 0 || phase >= get_phase_count()) return 0.0f;
+    std::lock_guard<std::recursive_mutex> lock(modelMutex);
+    return model->stepTrace.mean(count, [phase](const StepRecord& r) { return r.phaseMs[phase]; });
+}
+float get_trace_step_ms(int count)
+{
+    std::lock_guard<std::recursive_mutex> lock(modelMutex);
+    return model->stepTrace.mean(count, [](const StepRecord& r) { return r.stepMs; });
+}
+float get_trace_cells_visited(int count)
+{
+    std::lock_guard<std::recursive_mutex> lock(modelMutex);
+    return model->stepTrace.mean(count, [](const StepRecord& r) { return r.cellsVisited; });
+}
+float get_trace_attachments(int count)
+{
+    std::lock_guard<std::recursive_mutex> lock(modelMutex);
+    return model->stepTrace.mean(count, [](const StepRecord& r) { return r.attachments; });
+}
+float get_trace_render_ms(int count)
+{
+    std::lock_guard<std::recursive_mutex> lock(modelMutex);
+    return visualizer->frameTrace.mean(count, [](const FrameRecord& r) { return r.renderMs; });
+}
 
 
 int get_preset_count() { return static_cast<int>(getPresetCount()); }
@@ -144,8 +332,11 @@ void apply_preset(int index)
     set_kappa(preset.settings.kappa);
     set_rho(preset.settings.rho);
     set_theta(preset.settings.theta);
-    settings->gamma = preset.settings.gamma;
-    settings->sigma = preset.settings.sigma; // TODO: sigma does not do anything
+    set_sigma(preset.settings.sigma);
+    {
+        std::lock_guard<std::recursive_mutex> lock(modelMutex);
+        settings->gamma = preset.settings.gamma;
+    }
     set_grid_size(preset.settings.gridSize);
     reset();
     
@@ -165,6 +356,9 @@ void set_main_loop()
 
 void play_pause(bool paused)
 {
+    #ifdef GG_SIMULATION_THREAD
+    simulationPaused = paused;
+    #endif
     if (paused)
     {
         emscripten_cancel_main_loop();
@@ -187,8 +381,10 @@ EMSCRIPTEN_BINDINGS()
     emscripten::function("set_alpha", &set_alpha);
     emscripten::function("set_mu", &set_mu);
     emscripten::function("set_kappa", &set_kappa);
+    emscripten::function("set_sigma", &set_sigma);
     emscripten::function("play_pause", &play_pause);
     emscripten::function("set_iterations_per_frame", &set_iterations_per_frame);
+    emscripten::function("set_frame_budget", &set_frame_budget);
     emscripten::function("set_window_size", &set_window_size);
     emscripten::function("set_grid_size", &set_grid_size);
 
@@ -199,7 +395,18 @@ EMSCRIPTEN_BINDINGS()
     emscripten::function("get_current_rho", &get_current_rho);
     emscripten::function("get_current_theta", &get_current_theta);
     emscripten::function("get_current_gamma", &get_current_gamma);
+    emscripten::function("get_current_sigma", &get_current_sigma);
     emscripten::function("get_current_grid_size", &get_current_grid_size);
+    emscripten::function("get_steps_per_second", &get_steps_per_second);
+
+    emscripten::function("get_trace_enabled", &get_trace_enabled);
+    emscripten::function("get_phase_count", &get_phase_count);
+    emscripten::function("get_phase_name", &get_phase_name);
+    emscripten::function("get_trace_phase_ms", &get_trace_phase_ms);
+    emscripten::function("get_trace_step_ms", &get_trace_step_ms);
+    emscripten::function("get_trace_cells_visited", &get_trace_cells_visited);
+    emscripten::function("get_trace_attachments", &get_trace_attachments);
+    emscripten::function("get_trace_render_ms", &get_trace_render_ms);
 
     emscripten::function("get_preset_count", &get_preset_count);
     emscripten::function("get_preset_info", &get_preset_info);
@@ -208,9 +415,49 @@ EMSCRIPTEN_BINDINGS()
 #endif
 
 #ifndef __EMSCRIPTEN__
-int main()
+// With export=<directory|file.y4m|->, frames of the run are also written to
+// disk, as in frames.cpp: every=K steps apart (default 100), size=S pixels
+// (default 1000). With trace=<file>, a build with -DGG_TRACE writes its step
+// and frame records there (see TraceFile).
+int main(int argc, char** argv)
 {
+    std::string exportPath, tracePath;
+    FrameExportSettings exportSettings;
+    for (int k = 1; k < argc; ++k) {
+        const char* equals = std::strchr(argv[k], '=');
+        if (!equals) continue;
+        const std::string key(argv[k], equals - argv[k]);
+        if (key == "export") exportPath = equals + 1;
+        else if (key == "every") exportEvery = std::max(1, std::atoi(equals + 1));
+        else if (key == "size") exportSettings.size = std::atoi(equals + 1);
+        else if (key == "trace") tracePath = equals + 1;
+    }
+
     init();
+    if (!exportPath.empty()) {
+        const bool y4m = exportPath == "-" ||
+                         (exportPath.size() > 4 && exportPath.compare(exportPath.size() - 4, 4, ".y4m") == 0);
+        exportSettings.format = y4m ? FrameFormat::Y4M : FrameFormat::PNG;
+        std::lock_guard<std::recursive_mutex> lock(modelMutex);
+        exporter = new FrameExporter(*settings, exportPath, exportSettings);
+        if (!exporter->error().empty()) {
+            std::cerr << exporter->error() << std::endl;
+            return 1;
+        }
+    }
+    if (!tracePath.empty()) {
+        #ifndef GG_TRACE
+        std::cerr << "trace= needs a build with -DGG_TRACE" << std::endl;
+        return 1;
+        #endif
+        std::lock_guard<std::recursive_mutex> lock(modelMutex);
+        traceFile = new TraceFile(tracePath);
+        if (!traceFile->isOpen()) {
+            std::cerr << "can't write " << tracePath << std::endl;
+            return 1;
+        }
+    }
+
     bool running = true;
     SDL_Event event;
 
@@ -225,6 +472,7 @@ int main()
         }
         main_loop();
     }
+    finish_output();
     return 0;
 }
 #endif
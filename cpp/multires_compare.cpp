@@ -0,0 +1,111 @@
+// Multires comparison: runs a preset with MultiresModel and with a plain
+// model of the same size side by side, and checks that the two-level model
+// conserves mass and grows the same crystal. Build and run natively, e.g.
+//   g++ -std=c++17 -O3 -pthread ./cpp/multires_compare.cpp -o multires_compare
+//   ./multires_compare [preset=2] [grid=1024] [steps=3000] [coarse=8] [patch=256]
+//                      [tolerance=1e-5]
+// grid should be a multiple of 2 * coarse, which lines both seeds up. The
+// coupling at the edge of the patch is an approximation, so the crystals
+// only match until the vapor near it has drifted far enough to flip an
+// attachment; pick steps below that. Exits with status 1 when the crystals
+// differ within steps, or the total mass drifts by more than tolerance (a
+// share of the initial mass).
+#include "./src/gg_model.h"
+#include "./src/multires.h"
+#include "./src/presets.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Crystal sites where the two models disagree. Only the bounding box of both
+// crystals can hold any.
+int differingSites(const Model& plain, const MultiresModel<Model>& multires) {
+    const Extent a = plain.getCrystalExtent();
+    const Extent b = multires.getCrystalExtent();
+    const int P = multires.patch().getSettings().gridSize;
+    const int offset = multires.patchOffset();
+    int differing = 0;
+    for (int i = std::min(a.minRow, b.minRow); i <= std::max(a.maxRow, b.maxRow); ++i) {
+        for (int j = std::min(a.minCol, b.minCol); j <= std::max(a.maxCol, b.maxCol); ++j) {
+            const int x = i - offset;
+            const int y = j - offset;
+            const bool covered = x >= 0 && x < P && y >= 0 && y < P;
+            const bool crystal = covered && multires.patch().snowflake.isCrystalAt(x, y);
+            differing += crystal != plain.snowflake.isCrystalAt(i, j);
+        }
+    }
+    return differing;
+}
+
+// Largest vapor difference over the full grid
+float vaporError(const Model& plain, const MultiresModel<Model>& multires) {
+    const int N = multires.gridSize();
+    float error = 0.0f;
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < N; ++j) {
+            error = std::max(error, std::fabs(plain.vaporAt(i, j) - multires.vaporAt(i, j)));
+        }
+    }
+    return error;
+}
+
+int main(int argc, char** argv)
+{
+    int preset = 2, gridSize = 1024, steps = 3000, coarse = 8, patchSize = 256;
+    double tolerance = 1e-5;
+    for (int k = 1; k < argc; ++k) {
+        const char* equals = std::strchr(argv[k], '=');
+        if (!equals) {
+            std::fprintf(stderr, "multires_compare: expected key=value, got %s\n", argv[k]);
+            return 2;
+        }
+        const std::string key(argv[k], equals - argv[k]);
+        const char* value = equals + 1;
+        if (key == "preset") preset = std::atoi(value);
+        else if (key == "grid") gridSize = std::atoi(value);
+        else if (key == "steps") steps = std::atoi(value);
+        else if (key == "coarse") coarse = std::max(1, std::atoi(value));
+        else if (key == "patch") patchSize = std::atoi(value);
+        else if (key == "tolerance") tolerance = std::atof(value);
+        else {
+            std::fprintf(stderr, "multires_compare: unknown option %s\n", key.c_str());
+            return 2;
+        }
+    }
+    if (gridSize % (2 * coarse) != 0) {
+        std::fprintf(stderr, "multires_compare: grid must be a multiple of %d\n", 2 * coarse);
+        return 2;
+    }
+
+    // The plain model runs the geometry the patch is given
+    ModelSettings settings = getPreset(preset).settings;
+    settings.gridSize = gridSize;
+    settings.useSymmetry = false;
+    settings.hexDomain = false;
+    settings.vaporHalo = 0;
+    settings.threads = 1;
+    ModelSettings plainSettings = settings;
+
+    MultiresModel<Model> multires(settings, coarse, patchSize);
+    Model plain(plainSettings);
+    const double initialMass = multires.totalMass();
+
+    int step = 0, firstDifference = -1;
+    for (; step < steps && !plain.hasReachedBoundary() && !multires.hasReachedBoundary(); ++step) {
+        plain.time_step();
+        multires.time_step();
+        if (firstDifference < 0 && differingSites(plain, multires) > 0) firstDifference = step + 1;
+    }
+
+    const double drift = std::fabs(multires.totalMass() - initialMass) / initialMass;
+    std::printf("preset %d: %s, grid %d, coarse %d\n", preset, getPreset(preset).name.c_str(), gridSize, coarse);
+    std::printf("  steps %d (%s), differing sites %d, first difference at step %d\n", step,
+                multires.isCoupled() ? "coupled" : "patch is the whole grid", differingSites(plain, multires),
+                firstDifference);
+    std::printf("  mass drift %.3g (tolerance %.3g), max vapor difference %.3g\n",
+                drift, tolerance, vaporError(plain, multires));
+    return drift <= tolerance && firstDifference < 0 ? 0 : 1;
+}
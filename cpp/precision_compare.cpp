@@ -0,0 +1,94 @@
+// Precision comparison: runs presets with the float32 Grid and with each
+// 16-bit CompactGrid, and reports how far the crystal drifts from the float32
+// reference, to pick a precision per preset. Build and run natively, e.g.
+//   g++ -std=c++20 -O3 -pthread ./cpp/precision_compare.cpp -o precision_compare
+//   ./precision_compare [steps] [preset]
+// All presets are run when no preset is given. Every run computes the
+// symmetric wedge only, which gives the same results as the full hexagon.
+#include "./src/gg_model.h"
+#include "./src/presets.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Final state of one run, cell by cell over the whole hexagon
+struct Outcome {
+    int steps;
+    std::vector<uint8_t> crystal;
+    std::vector<float> crystalMass;
+};
+
+template <typename Layout>
+constexpr size_t bytesPerCell() {
+    // Flags, boundary mass, crystal mass and both diffusion buffers
+    if constexpr (isCompactGrid<Layout>) {
+        return 2 * sizeof(uint8_t) + sizeof(float) + sizeof(typename Layout::Solid::Storage) +
+               2 * sizeof(typename Layout::Vapor::Storage);
+    } else {
+        return 2 * sizeof(uint8_t) + 4 * sizeof(float);
+    }
+}
+
+template <typename Layout>
+Outcome run(ModelSettings settings, int steps) {
+    BasicModel<Layout> model(settings);
+    Outcome outcome = {0, {}, {}};
+    for (; outcome.steps < steps && !model.hasReachedBoundary(); ++outcome.steps) {
+        model.time_step();
+    }
+
+    const Layout& grid = model.fullGrid();
+    for (int i = 0; i < grid.domain.rows(); ++i) {
+        for (int j = grid.domain[i].begin; j < grid.domain[i].end; ++j) {
+            outcome.crystal.push_back(grid.isCrystalAt(i, j));
+            outcome.crystalMass.push_back(grid.crystalMassAt(i, j));
+        }
+    }
+    return outcome;
+}
+
+// One line of the table: the crystal sites that differ from the reference
+// (as a share of the reference crystal) and the largest crystal mass error
+// over the sites that are crystal in both
+void report(const char* name, size_t bytes, const Outcome& outcome, const Outcome& reference) {
+    int sites = 0, referenceSites = 0, differing = 0;
+    float massError = 0.0f;
+    for (size_t k = 0; k < outcome.crystal.size(); ++k) {
+        sites += outcome.crystal[k];
+        referenceSites += reference.crystal[k];
+        differing += outcome.crystal[k] != reference.crystal[k];
+        if (outcome.crystal[k] && reference.crystal[k]) {
+            massError = std::max(massError, std::fabs(outcome.crystalMass[k] - reference.crystalMass[k]));
+        }
+    }
+
+    std::printf("  %-9s %10zu %7d %9d %10d %10.3f%% %12.6f\n", name, bytes, outcome.steps, sites, differing,
+                referenceSites > 0 ? 100.0 * differing / referenceSites : 0.0, massError);
+}
+
+int main(int argc, char** argv)
+{
+    const int steps = argc > 1 ? std::atoi(argv[1]) : 5000;
+    const int first = argc > 2 ? std::atoi(argv[2]) : 0;
+    const int last = argc > 2 ? first + 1 : static_cast<int>(getPresetCount());
+
+    for (int index = first; index < last; ++index) {
+        ModelSettings settings = getPreset(index).settings;
+        settings.fusedStep = true;
+        settings.useSymmetry = true;
+
+        const Outcome reference = run<Grid>(settings, steps);
+        const Outcome half = run<CompactGrid<HalfPrecision>>(settings, steps);
+        const Outcome fixed = run<CompactGrid<FixedPrecision>>(settings, steps);
+
+        std::printf("preset %d: %s\n", index, getPreset(index).name.c_str());
+        std::printf("  %-9s %10s %7s %9s %10s %11s %12s\n",
+                    "precision", "bytes/cell", "steps", "crystal", "differing", "divergence", "mass error");
+        report("float32", bytesPerCell<Grid>(), reference, reference);
+        report("half", bytesPerCell<CompactGrid<HalfPrecision>>(), half, reference);
+        report("fixed16", bytesPerCell<CompactGrid<FixedPrecision>>(), fixed, reference);
+    }
+    return 0;
+}
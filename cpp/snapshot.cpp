@@ -0,0 +1,131 @@
+// Snapshot tool: long runs that write a checkpoint every so often, resuming
+// them after an interruption, and a look inside a checkpoint. Build natively:
+//   g++ -std=c++17 -O3 -pthread ./cpp/snapshot.cpp -o snapshot
+//   ./snapshot run <file> [preset=2] [grid=4096] [steps=100000] [every=1000]
+//                  [threads=8] [symmetric=1] [raw=1]
+//   ./snapshot resume <file> [steps=200000] [every=1000] [threads=8]
+//   ./snapshot info <file>
+// steps is the total for the run, counted from its start, and every the
+// steps between checkpoints. Runs stop early when the crystal reaches the
+// edge. raw=1 stores the vapor uncompressed. A resumed run continues bit for
+// bit as if it had never stopped.
+#include "./src/gg_model.h"
+#include "./src/presets.h"
+#include "./src/snapshot.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+struct Options {
+    int preset = 0;
+    int gridSize = 0;   // The preset's by default
+    long long steps = 100000;
+    long long every = 1000;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    bool symmetric = false;
+    bool raw = false;
+};
+
+[[noreturn]] void fail(const std::string& message) {
+    std::fprintf(stderr, "snapshot: %s\n", message.c_str());
+    std::exit(1);
+}
+
+Options parseOptions(int argc, char** argv, int first) {
+    Options options;
+    for (int k = first; k < argc; ++k) {
+        const char* equals = std::strchr(argv[k], '=');
+        if (!equals) fail(std::string("expected key=value, got ") + argv[k]);
+        const std::string key(argv[k], equals - argv[k]);
+        const long long value = std::atoll(equals + 1);
+        if (key == "preset") options.preset = static_cast<int>(value);
+        else if (key == "grid") options.gridSize = static_cast<int>(value);
+        else if (key == "steps") options.steps = value;
+        else if (key == "every") options.every = std::max(1LL, value);
+        else if (key == "threads") options.threads = std::max(1, static_cast<int>(value));
+        else if (key == "symmetric") options.symmetric = value != 0;
+        else if (key == "raw") options.raw = value != 0;
+        else fail("unknown option " + key);
+    }
+    return options;
+}
+
+// Steps the model to options.steps, writing a checkpoint every options.every
+// steps and at the end
+void advance(Model& model, const std::string& path, const Options& options) {
+    long long step = static_cast<long long>(model.progress().steps);
+    while (step < options.steps && !model.hasReachedBoundary()) {
+        const long long target = std::min(options.steps, (step / options.every + 1) * options.every);
+        for (; step < target && !model.hasReachedBoundary(); ++step) {
+            model.time_step();
+        }
+        if (!saveSnapshot(path, model, !options.raw)) fail("can't write " + path);
+        std::printf("step %lld: checkpoint written\n", step);
+        std::fflush(stdout);
+    }
+    std::printf("%s at step %lld\n", model.hasReachedBoundary() ? "reached the edge" : "done", step);
+}
+
+void info(const Snapshot& snapshot) {
+    const SnapshotHeader& head = snapshot.header();
+    const char* kinds[] = {"domain", "crystal", "boundary", "boundary mass", "crystal mass", "diffusive mass"};
+    const char* encodings[] = {"raw", "runs", "sparse", "rle"};
+
+    std::printf("version %u, %llu bytes\n", head.version, static_cast<unsigned long long>(snapshot.fileBytes()));
+    std::printf("grid %d%s%s, %u rows, %llu cells\n", head.gridSize, head.hexDomain ? " hexagon" : "",
+                head.useSymmetry ? " (symmetric wedge)" : "", head.rows, static_cast<unsigned long long>(head.cells));
+    std::printf("rho %g beta %g kappa %g mu %g gamma %g theta %g alpha %g sigma %g seed %u\n",
+                head.rho, head.beta, head.kappa, head.mu, head.gamma, head.theta, head.alpha, head.sigma, head.seed);
+    std::printf("step %llu, %llu crystal sites, reach %d, active rows %d..%d cols %d..%d\n",
+                static_cast<unsigned long long>(head.steps), static_cast<unsigned long long>(snapshot.crystalSites()),
+                head.crystalReach, head.lowerRow, head.upperRow, head.lowerCol, head.upperCol);
+    for (auto& section : snapshot.sections()) {
+        std::printf("  %-15s %-7s %10llu entries %12llu bytes\n",
+                    section.kind < 6 ? kinds[section.kind] : "?", section.encoding < 4 ? encodings[section.encoding] : "?",
+                    static_cast<unsigned long long>(section.count), static_cast<unsigned long long>(section.bytes));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        fail("usage: snapshot run|resume|info <file> [key=value ...]");
+    }
+    const std::string command = argv[1];
+    const std::string path = argv[2];
+    const Options options = parseOptions(argc, argv, 3);
+
+    if (command == "run") {
+        if (options.preset < 0 || options.preset >= static_cast<int>(getPresetCount())) fail("no such preset");
+        ModelSettings settings = getPreset(options.preset).settings;
+        if (options.gridSize > 0) settings.gridSize = options.gridSize;
+        settings.fusedStep = true;
+        settings.hexDomain = true;
+        settings.useSymmetry = options.symmetric;
+        settings.threads = options.threads;
+        Model model(settings);
+        advance(model, path, options);
+        return 0;
+    }
+
+    std::string error;
+    std::unique_ptr<Snapshot> snapshot = Snapshot::open(path, error);
+    if (!snapshot) fail(error);
+
+    if (command == "info") {
+        info(*snapshot);
+    } else if (command == "resume") {
+        ModelSettings settings = snapshot->settings();
+        settings.threads = options.threads;
+        Model model(settings);
+        if (!snapshot->restore(model)) fail(path + " doesn't match the grid its settings give");
+        snapshot.reset();
+        advance(model, path, options);
+    } else {
+        fail("unknown command " + command);
+    }
+    return 0;
+}
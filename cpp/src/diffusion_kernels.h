@@ -0,0 +1,197 @@
+#ifndef GG_DIFFUSION_KERNELS_H
+#define GG_DIFFUSION_KERNELS_H
+
+// Row kernels for the 7-point hex diffusion stencil on the struct-of-arrays
+// grid. A neighbor that is crystal (or lies in the halo, which is marked as
+// crystal) contributes the center value instead of its own, and crystal
+// sites end up with no diffusive mass. The sum is accumulated in the same
+// order as BasicModel::diffusedMass, so every kernel is bit-identical to the
+// scalar reference.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GG_RUNTIME_AVX2 1
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE2__) || defined(GG_RUNTIME_AVX2)
+#include <immintrin.h>
+#endif
+
+// Rows i-1, i and i+1 of the diffusive mass and crystal fields, plus row i
+// of the output. Column -1 and column N must be readable (halo). Crystal
+// flags are bytes, widened to 32-bit lane masks as they are loaded.
+struct StencilRows {
+    const float* above;
+    const float* row;
+    const float* below;
+    const uint8_t* crystalAbove;
+    const uint8_t* crystalRow;
+    const uint8_t* crystalBelow;
+    float* out;
+};
+
+// Center plus six neighbors, given as opposite pairs. The pairs are added
+// first and the pair sums smallest first, so the result doesn't depend on
+// which way round the neighborhood is read: any symmetry of the hex lattice
+// gives a bit-identical sum.
+inline float stencilSum(float own, float pairA, float pairB, float pairC) {
+    const float low = std::min(pairA, std::min(pairB, pairC));
+    const float high = std::max(pairA, std::max(pairB, pairC));
+    const float middle = std::max(std::min(pairA, pairB), std::min(std::max(pairA, pairB), pairC));
+    return own + ((low + middle) + high);
+}
+
+using DiffuseRowKernel = void (*)(const StencilRows&, int colBegin, int colEnd, float weight);
+
+// Scalar reference
+inline void diffuseRowScalar(const StencilRows& r, int colBegin, int colEnd, float weight) {
+    for (int j = colBegin; j < colEnd; ++j) {
+        if (r.crystalRow[j]) {
+            r.out[j] = 0.0f;
+            continue;
+        }
+
+        const float own = r.row[j];
+        const float sum = stencilSum(own,
+            (r.crystalAbove[j - 1] ? own : r.above[j - 1]) + (r.crystalBelow[j + 1] ? own : r.below[j + 1]),
+            (r.crystalAbove[j] ? own : r.above[j]) + (r.crystalBelow[j] ? own : r.below[j]),
+            (r.crystalRow[j - 1] ? own : r.row[j - 1]) + (r.crystalRow[j + 1] ? own : r.row[j + 1]));
+        r.out[j] = weight * sum;
+    }
+}
+
+#if defined(__SSE2__) && !defined(__wasm_simd128__)
+// All ones in the lanes of the four sites that are not crystal
+inline __m128 vaporMaskSSE(const uint8_t* crystal) {
+    int flags;
+    std::memcpy(&flags, crystal, sizeof(flags));
+    __m128i mask = _mm_cmpeq_epi8(_mm_cvtsi32_si128(flags), _mm_setzero_si128());
+    mask = _mm_unpacklo_epi8(mask, mask);
+    return _mm_castsi128_ps(_mm_unpacklo_epi16(mask, mask));
+}
+
+// Neighbor value where the neighbor is vapor, the center value where it is crystal
+inline __m128 neighborOrOwnSSE(const uint8_t* crystal, const float* mass, __m128 own) {
+    const __m128 isVapor = vaporMaskSSE(crystal);
+    return _mm_or_ps(_mm_and_ps(isVapor, _mm_loadu_ps(mass)), _mm_andnot_ps(isVapor, own));
+}
+
+inline void diffuseRowSSE(const StencilRows& r, int colBegin, int colEnd, float weight) {
+    const __m128 w = _mm_set1_ps(weight);
+    int j = colBegin;
+    for (; j + 4 <= colEnd; j += 4) {
+        const __m128 own = _mm_loadu_ps(r.row + j);
+        const __m128 pairA = _mm_add_ps(neighborOrOwnSSE(r.crystalAbove + j - 1, r.above + j - 1, own),
+                                        neighborOrOwnSSE(r.crystalBelow + j + 1, r.below + j + 1, own));
+        const __m128 pairB = _mm_add_ps(neighborOrOwnSSE(r.crystalAbove + j, r.above + j, own),
+                                        neighborOrOwnSSE(r.crystalBelow + j, r.below + j, own));
+        const __m128 pairC = _mm_add_ps(neighborOrOwnSSE(r.crystalRow + j - 1, r.row + j - 1, own),
+                                        neighborOrOwnSSE(r.crystalRow + j + 1, r.row + j + 1, own));
+        const __m128 low = _mm_min_ps(pairA, _mm_min_ps(pairB, pairC));
+        const __m128 high = _mm_max_ps(pairA, _mm_max_ps(pairB, pairC));
+        const __m128 middle = _mm_max_ps(_mm_min_ps(pairA, pairB), _mm_min_ps(_mm_max_ps(pairA, pairB), pairC));
+        const __m128 sum = _mm_add_ps(own, _mm_add_ps(_mm_add_ps(low, middle), high));
+
+        // Crystal sites have no diffusive mass
+        _mm_storeu_ps(r.out + j, _mm_and_ps(vaporMaskSSE(r.crystalRow + j), _mm_mul_ps(w, sum)));
+    }
+    diffuseRowScalar(r, j, colEnd, weight);
+}
+#endif
+
+#ifdef GG_RUNTIME_AVX2
+// Compiled for AVX2 regardless of the build flags, only called after a CPU check
+__attribute__((target("avx2")))
+inline __m256 vaporMaskAVX2(const uint8_t* crystal) {
+    const __m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(crystal)));
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(flags, _mm256_setzero_si256()));
+}
+
+__attribute__((target("avx2")))
+inline __m256 neighborOrOwnAVX2(const uint8_t* crystal, const float* mass, __m256 own) {
+    const __m256 isVapor = vaporMaskAVX2(crystal);
+    return _mm256_blendv_ps(own, _mm256_loadu_ps(mass), isVapor);
+}
+
+__attribute__((target("avx2")))
+inline void diffuseRowAVX2(const StencilRows& r, int colBegin, int colEnd, float weight) {
+    const __m256 w = _mm256_set1_ps(weight);
+    int j = colBegin;
+    for (; j + 8 <= colEnd; j += 8) {
+        const __m256 own = _mm256_loadu_ps(r.row + j);
+        const __m256 pairA = _mm256_add_ps(neighborOrOwnAVX2(r.crystalAbove + j - 1, r.above + j - 1, own),
+                                           neighborOrOwnAVX2(r.crystalBelow + j + 1, r.below + j + 1, own));
+        const __m256 pairB = _mm256_add_ps(neighborOrOwnAVX2(r.crystalAbove + j, r.above + j, own),
+                                           neighborOrOwnAVX2(r.crystalBelow + j, r.below + j, own));
+        const __m256 pairC = _mm256_add_ps(neighborOrOwnAVX2(r.crystalRow + j - 1, r.row + j - 1, own),
+                                           neighborOrOwnAVX2(r.crystalRow + j + 1, r.row + j + 1, own));
+        const __m256 low = _mm256_min_ps(pairA, _mm256_min_ps(pairB, pairC));
+        const __m256 high = _mm256_max_ps(pairA, _mm256_max_ps(pairB, pairC));
+        const __m256 middle = _mm256_max_ps(_mm256_min_ps(pairA, pairB), _mm256_min_ps(_mm256_max_ps(pairA, pairB), pairC));
+        const __m256 sum = _mm256_add_ps(own, _mm256_add_ps(_mm256_add_ps(low, middle), high));
+
+        // Crystal sites have no diffusive mass
+        _mm256_storeu_ps(r.out + j, _mm256_and_ps(vaporMaskAVX2(r.crystalRow + j), _mm256_mul_ps(w, sum)));
+    }
+    diffuseRowScalar(r, j, colEnd, weight);
+}
+#endif
+
+#ifdef __wasm_simd128__
+inline v128_t vaporMaskWasm(const uint8_t* crystal) {
+    const v128_t flags = wasm_u32x4_extend_low_u16x8(wasm_u16x8_extend_low_u8x16(wasm_v128_load32_zero(crystal)));
+    return wasm_i32x4_eq(flags, wasm_i32x4_splat(0));
+}
+
+inline v128_t neighborOrOwnWasm(const uint8_t* crystal, const float* mass, v128_t own) {
+    const v128_t isVapor = vaporMaskWasm(crystal);
+    return wasm_v128_bitselect(wasm_v128_load(mass), own, isVapor);
+}
+
+inline void diffuseRowWasm(const StencilRows& r, int colBegin, int colEnd, float weight) {
+    const v128_t w = wasm_f32x4_splat(weight);
+    int j = colBegin;
+    for (; j + 4 <= colEnd; j += 4) {
+        const v128_t own = wasm_v128_load(r.row + j);
+        const v128_t pairA = wasm_f32x4_add(neighborOrOwnWasm(r.crystalAbove + j - 1, r.above + j - 1, own),
+                                            neighborOrOwnWasm(r.crystalBelow + j + 1, r.below + j + 1, own));
+        const v128_t pairB = wasm_f32x4_add(neighborOrOwnWasm(r.crystalAbove + j, r.above + j, own),
+                                            neighborOrOwnWasm(r.crystalBelow + j, r.below + j, own));
+        const v128_t pairC = wasm_f32x4_add(neighborOrOwnWasm(r.crystalRow + j - 1, r.row + j - 1, own),
+                                            neighborOrOwnWasm(r.crystalRow + j + 1, r.row + j + 1, own));
+        const v128_t low = wasm_f32x4_min(pairA, wasm_f32x4_min(pairB, pairC));
+        const v128_t high = wasm_f32x4_max(pairA, wasm_f32x4_max(pairB, pairC));
+        const v128_t middle = wasm_f32x4_max(wasm_f32x4_min(pairA, pairB), wasm_f32x4_min(wasm_f32x4_max(pairA, pairB), pairC));
+        const v128_t sum = wasm_f32x4_add(own, wasm_f32x4_add(wasm_f32x4_add(low, middle), high));
+
+        // Crystal sites have no diffusive mass
+        wasm_v128_store(r.out + j, wasm_v128_and(vaporMaskWasm(r.crystalRow + j), wasm_f32x4_mul(w, sum)));
+    }
+    diffuseRowScalar(r, j, colEnd, weight);
+}
+#endif
+
+// Widest kernel the build and the CPU support
+inline DiffuseRowKernel selectDiffuseRowKernel() {
+#if defined(__wasm_simd128__)
+    return diffuseRowWasm;
+#else
+#ifdef GG_RUNTIME_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return diffuseRowAVX2;
+    }
+#endif
+#if defined(__SSE2__)
+    return diffuseRowSSE;
+#else
+    return diffuseRowScalar;
+#endif
+#endif
+}
+
+#endif // GG_DIFFUSION_KERNELS_H
@@ -0,0 +1,658 @@
+#ifndef GG_ENSEMBLE_H
+#define GG_ENSEMBLE_H
+
+#include "gg_model.h"
+#include <array>
+
+// Diffusion kernels for the ensemble: the stencil of diffusion_kernels.h
+// with `lanes` members interleaved per cell, so vectors run across the
+// members of one cell rather than along the row. Values of cell j start at
+// index j * lanes of each row. Members flagged in retired copy their vapor
+// over unchanged.
+using DiffuseLanesKernel = void (*)(const StencilRows&, int colBegin, int colEnd, float weight,
+                                    int lanes, const uint8_t* retired);
+
+inline void diffuseLanesScalar(const StencilRows& r, int colBegin, int colEnd, float weight,
+                               int lanes, const uint8_t* retired) {
+    for (int j = colBegin; j < colEnd; ++j) {
+        for (int k = 0; k < lanes; ++k) {
+            const int at = j * lanes + k;
+            const float own = r.row[at];
+            float diffused = 0.0f;
+            if (!r.crystalRow[at]) {
+                const float sum = stencilSum(own,
+                    (r.crystalAbove[at - lanes] ? own : r.above[at - lanes]) + (r.crystalBelow[at + lanes] ? own : r.below[at + lanes]),
+                    (r.crystalAbove[at] ? own : r.above[at]) + (r.crystalBelow[at] ? own : r.below[at]),
+                    (r.crystalRow[at - lanes] ? own : r.row[at - lanes]) + (r.crystalRow[at + lanes] ? own : r.row[at + lanes]));
+                diffused = weight * sum;
+            }
+            r.out[at] = retired[k] ? own : diffused;
+        }
+    }
+}
+
+#if defined(__SSE2__) && !defined(__wasm_simd128__)
+inline void diffuseLanesSSE(const StencilRows& r, int colBegin, int colEnd, float weight,
+                            int lanes, const uint8_t* retired) {
+    const __m128 w = _mm_set1_ps(weight);
+    for (int j = colBegin; j < colEnd; ++j) {
+        for (int k = 0; k < lanes; k += 4) {
+            const int at = j * lanes + k;
+            const __m128 own = _mm_loadu_ps(r.row + at);
+            const __m128 pairA = _mm_add_ps(neighborOrOwnSSE(r.crystalAbove + at - lanes, r.above + at - lanes, own),
+                                            neighborOrOwnSSE(r.crystalBelow + at + lanes, r.below + at + lanes, own));
+            const __m128 pairB = _mm_add_ps(neighborOrOwnSSE(r.crystalAbove + at, r.above + at, own),
+                                            neighborOrOwnSSE(r.crystalBelow + at, r.below + at, own));
+            const __m128 pairC = _mm_add_ps(neighborOrOwnSSE(r.crystalRow + at - lanes, r.row + at - lanes, own),
+                                            neighborOrOwnSSE(r.crystalRow + at + lanes, r.row + at + lanes, own));
+            const __m128 low = _mm_min_ps(pairA, _mm_min_ps(pairB, pairC));
+            const __m128 high = _mm_max_ps(pairA, _mm_max_ps(pairB, pairC));
+            const __m128 middle = _mm_max_ps(_mm_min_ps(pairA, pairB), _mm_min_ps(_mm_max_ps(pairA, pairB), pairC));
+            const __m128 sum = _mm_add_ps(own, _mm_add_ps(_mm_add_ps(low, middle), high));
+            const __m128 diffused = _mm_and_ps(vaporMaskSSE(r.crystalRow + at), _mm_mul_ps(w, sum));
+
+            const __m128 live = vaporMaskSSE(retired + k);
+            _mm_storeu_ps(r.out + at, _mm_or_ps(_mm_and_ps(live, diffused), _mm_andnot_ps(live, own)));
+        }
+    }
+}
+#endif
+
+#ifdef GG_RUNTIME_AVX2
+__attribute__((target("avx2")))
+inline void diffuseLanesAVX2(const StencilRows& r, int colBegin, int colEnd, float weight,
+                             int lanes, const uint8_t* retired) {
+    const __m256 w = _mm256_set1_ps(weight);
+    for (int j = colBegin; j < colEnd; ++j) {
+        for (int k = 0; k < lanes; k += 8) {
+            const int at = j * lanes + k;
+            const __m256 own = _mm256_loadu_ps(r.row + at);
+            const __m256 pairA = _mm256_add_ps(neighborOrOwnAVX2(r.crystalAbove + at - lanes, r.above + at - lanes, own),
+                                               neighborOrOwnAVX2(r.crystalBelow + at + lanes, r.below + at + lanes, own));
+            const __m256 pairB = _mm256_add_ps(neighborOrOwnAVX2(r.crystalAbove + at, r.above + at, own),
+                                               neighborOrOwnAVX2(r.crystalBelow + at, r.below + at, own));
+            const __m256 pairC = _mm256_add_ps(neighborOrOwnAVX2(r.crystalRow + at - lanes, r.row + at - lanes, own),
+                                               neighborOrOwnAVX2(r.crystalRow + at + lanes, r.row + at + lanes, own));
+            const __m256 low = _mm256_min_ps(pairA, _mm256_min_ps(pairB, pairC));
+            const __m256 high = _mm256_max_ps(pairA, _mm256_max_ps(pairB, pairC));
+            const __m256 middle = _mm256_max_ps(_mm256_min_ps(pairA, pairB), _mm256_min_ps(_mm256_max_ps(pairA, pairB), pairC));
+            const __m256 sum = _mm256_add_ps(own, _mm256_add_ps(_mm256_add_ps(low, middle), high));
+            const __m256 diffused = _mm256_and_ps(vaporMaskAVX2(r.crystalRow + at), _mm256_mul_ps(w, sum));
+
+            _mm256_storeu_ps(r.out + at, _mm256_blendv_ps(own, diffused, vaporMaskAVX2(retired + k)));
+        }
+    }
+}
+#endif
+
+#ifdef __wasm_simd128__
+inline void diffuseLanesWasm(const StencilRows& r, int colBegin, int colEnd, float weight,
+                             int lanes, const uint8_t* retired) {
+    const v128_t w = wasm_f32x4_splat(weight);
+    for (int j = colBegin; j < colEnd; ++j) {
+        for (int k = 0; k < lanes; k += 4) {
+            const int at = j * lanes + k;
+            const v128_t own = wasm_v128_load(r.row + at);
+            const v128_t pairA = wasm_f32x4_add(neighborOrOwnWasm(r.crystalAbove + at - lanes, r.above + at - lanes, own),
+                                                neighborOrOwnWasm(r.crystalBelow + at + lanes, r.below + at + lanes, own));
+            const v128_t pairB = wasm_f32x4_add(neighborOrOwnWasm(r.crystalAbove + at, r.above + at, own),
+                                                neighborOrOwnWasm(r.crystalBelow + at, r.below + at, own));
+            const v128_t pairC = wasm_f32x4_add(neighborOrOwnWasm(r.crystalRow + at - lanes, r.row + at - lanes, own),
+                                                neighborOrOwnWasm(r.crystalRow + at + lanes, r.row + at + lanes, own));
+            const v128_t low = wasm_f32x4_min(pairA, wasm_f32x4_min(pairB, pairC));
+            const v128_t high = wasm_f32x4_max(pairA, wasm_f32x4_max(pairB, pairC));
+            const v128_t middle = wasm_f32x4_max(wasm_f32x4_min(pairA, pairB), wasm_f32x4_min(wasm_f32x4_max(pairA, pairB), pairC));
+            const v128_t sum = wasm_f32x4_add(own, wasm_f32x4_add(wasm_f32x4_add(low, middle), high));
+            const v128_t diffused = wasm_v128_and(vaporMaskWasm(r.crystalRow + at), wasm_f32x4_mul(w, sum));
+
+            wasm_v128_store(r.out + at, wasm_v128_bitselect(diffused, own, vaporMaskWasm(retired + k)));
+        }
+    }
+}
+#endif
+
+// Widest kernel the build, the CPU and the lane count support
+inline DiffuseLanesKernel selectDiffuseLanesKernel(int lanes) {
+#if defined(__wasm_simd128__)
+    if (lanes % 4 == 0) {
+        return diffuseLanesWasm;
+    }
+#else
+#ifdef GG_RUNTIME_AVX2
+    if (lanes % 8 == 0 && __builtin_cpu_supports("avx2")) {
+        return diffuseLanesAVX2;
+    }
+#endif
+#if defined(__SSE2__)
+    if (lanes % 4 == 0) {
+        return diffuseLanesSSE;
+    }
+#endif
+#endif
+    return diffuseLanesScalar;
+}
+
+// Lockstep ensemble: up to Lanes models that differ only in the scalar
+// parameters (rho, beta, kappa, mu, gamma, theta, alpha, sigma), stepped
+// together. Every cell stores one value per member side by side, so one sweep
+// of the diffusion stencil advances all of them Lanes wide. Freezing,
+// attachment and melting run over each member's own frontier, as in the
+// fused step. A member retires once it reaches the boundary, or
+// when retire() is called, and keeps its state from then on; the others go on.
+//
+// Each member matches a BasicModel<Grid> with its settings bit for bit. The
+// sweep covers the union of the members' active regions, which is harmless:
+// a far-field cell swept like any other gets exactly the closed-form
+// far-field value. Grid size, domain, symmetry, seed and boundary margin are
+// the first member's. vaporHalo is not supported; threads and fusedStep are
+// ignored.
+template <int Lanes>
+class EnsembleModel {
+    public:
+        using Floats = std::array<float, Lanes>;
+        using Flags = std::array<uint8_t, Lanes>;
+        static_assert(sizeof(Floats) == Lanes * sizeof(float) && sizeof(Flags) == Lanes,
+                      "the kernels read a row of cells as one array of lanes");
+
+        explicit EnsembleModel(const std::vector<ModelSettings>& members);
+        // Steps every member that is still live once
+        void time_step();
+        int size() const { return count; }
+        bool isLive(int k) const { return live[k]; }
+        int liveCount() const;
+        void retire(int k) { live[k] = 0; }
+        bool hasReachedBoundary(int k) const;
+        uint64_t steps(int k) const { return stepsTaken[k]; }
+        const Extent& getCrystalExtent(int k) const { return crystalExtent[k]; }
+        // Member k's settings, with the shared ones taken from the first member
+        const ModelSettings& getSettings(int k) const { return members[k]; }
+        ModelProgress progress(int k) const;
+        // Hands member k to a model made with getSettings(k), the way a
+        // checkpoint is resumed: the model can then be read, drawn or stepped on
+        void exportMember(int k, BasicModel<Grid>& model) const;
+    private:
+        const float kernelWeight = 1.0f / 7.0f;
+        int count;
+        std::vector<ModelSettings> members;
+        int rows, cols;
+        int lower_bound_row, upper_bound_row;   // Union of the members' active regions
+        int lower_bound_col, upper_bound_col;
+        uint64_t stepCount = 0;
+
+        bool symmetric;
+        bool hexagonal;
+        int origin;
+        Point center;
+        std::vector<std::pair<Point, Point>> ghosts;
+
+        Domain domain;
+        Field<Flags> isCrystal;     // Halo marked as crystal, as in Grid
+        Field<Flags> isBoundary;
+        Field<Floats> boundaryMass;
+        Field<Floats> crystalMass;
+        Field<Floats> diffusiveMass;
+        Field<Floats> nextDiffusiveMass;
+
+        // Per member
+        Flags live = {};
+        Flags retired = {};     // !live, for the diffusion kernels
+        Floats ambient, kappa, mu, gamma, beta, theta, alpha;
+        Floats noiseLow, noiseHigh;     // 1 -+ sigma, or 1 for members without noise
+        bool noisy = false;
+        std::array<uint64_t, Lanes> stepsTaken = {};
+        std::array<Extent, Lanes> crystalExtent;
+        std::array<int, Lanes> crystalReach = {};
+        std::array<std::vector<Point>, Lanes> frontier;
+        std::vector<Point> attached, nextFrontier;
+
+        const Point neighbors[6] = {
+            {-1, -1}, {-1, 0},
+            {0, -1}, {0, 1},
+            {1, 0}, {1, 1}
+        };
+
+        Point canonical(int i, int j) const { return symmetric ? wedgeImage(center, i, j) : Point{i, j}; }
+        int colBegin(int i) const { return std::max(lower_bound_col, domain[i].begin); }
+        int colEnd(int i) const { return std::min(upper_bound_col, domain[i].end - (symmetric ? 1 : 0)); }
+        void refreshGhosts();
+        void growActiveRegion(int rowBegin, int rowEnd, int colBegin, int colEnd);
+        void fillFarField(int rowBegin, int rowEnd, int colBegin, int colEnd);
+        bool isFarField(int i, int j) const;
+        void shrinkActiveRegion();
+
+        void diffusionFreezing();
+        void diffuseRow(int i);
+        DiffuseLanesKernel diffuseLanes = selectDiffuseLanesKernel(Lanes);
+        void freezing(int k);
+        void attachment(int k);
+        bool attaches(int k, int i, int j) const;
+        void melting(int k);
+        void noise();
+};
+
+template <int Lanes>
+EnsembleModel<Lanes>::EnsembleModel(const std::vector<ModelSettings>& settings)
+    : count(std::min(static_cast<int>(settings.size()), Lanes)), members(settings) {
+    // Lanes past the last member copy the first one and never run
+    members.resize(Lanes, settings.front());
+    const ModelSettings shared = members.front();
+    for (ModelSettings& member : members) {
+        member.gridSize = shared.gridSize;
+        member.useSymmetry = shared.useSymmetry;
+        member.hexDomain = shared.hexDomain;
+        member.seed = shared.seed;
+        member.boundaryMargin = shared.boundaryMargin;
+        member.vaporHalo = 0;
+    }
+    const int N = shared.gridSize;
+    symmetric = shared.useSymmetry;
+    hexagonal = shared.hexDomain || shared.useSymmetry;
+    origin = symmetric ? 1 : 0;
+    center = symmetric ? Point{origin, origin} : Point{N / 2, N / 2};
+
+    Floats rho;
+    for (int k = 0; k < Lanes; ++k) {
+        const ModelSettings& s = members[k];
+        live[k] = k < count;
+        rho[k] = s.rho;
+        ambient[k] = Grid::vaporStep(s.rho);
+        kappa[k] = s.kappa;
+        mu[k] = s.mu;
+        gamma[k] = s.gamma;
+        beta[k] = s.beta;
+        theta[k] = s.theta;
+        alpha[k] = s.alpha;
+        noiseLow[k] = s.sigma != 0.0f ? 1.0f - s.sigma : 1.0f;
+        noiseHigh[k] = s.sigma != 0.0f ? 1.0f + s.sigma : 1.0f;
+        noisy = noisy || (live[k] && s.sigma != 0.0f);
+        crystalExtent[k] = {N / 2, N / 2, N / 2, N / 2};
+    }
+
+    Flags none = {}, all;
+    all.fill(1);
+    domain = symmetric ? wedgeDomain(N) : gridDomain(shared);
+    isCrystal = Field<Flags>(domain.extents, none, 1, all);
+    isBoundary = Field<Flags>(domain.extents, none);
+    boundaryMass = Field<Floats>(domain.extents, Floats{});
+    crystalMass = Field<Floats>(domain.extents, Floats{});
+    diffusiveMass = Field<Floats>(domain.extents, rho, 1);
+    nextDiffusiveMass = Field<Floats>(domain.extents, Floats{}, 1);
+    rows = domain.rows();
+    cols = 0;
+    for (auto& extent : domain.extents) {
+        cols = std::max(cols, extent.end);
+    }
+
+    lower_bound_row = std::max(center.first - 1, origin);
+    upper_bound_row = center.first + 2;
+    lower_bound_col = std::max(center.second - 1, origin);
+    upper_bound_col = center.second + 2;
+
+    // The same seed for every member
+    isCrystal[center.first][center.second] = all;
+    crystalMass[center.first][center.second].fill(1.0f);
+    diffusiveMass[center.first][center.second].fill(0.0f);
+    for (auto& neighbor : neighbors) {
+        const Point site = canonical(center.first + neighbor.first, center.second + neighbor.second);
+        if (!isBoundary[site.first][site.second][0]) {
+            isBoundary[site.first][site.second] = all;
+            for (auto& sites : frontier) {
+                sites.push_back(site);
+            }
+        }
+    }
+
+    if (symmetric) {
+        ghosts = wedgeGhosts(domain, center);
+    }
+}
+
+template <int Lanes>
+int EnsembleModel<Lanes>::liveCount() const {
+    int alive = 0;
+    for (int k = 0; k < Lanes; ++k) {
+        alive += live[k];
+    }
+    return alive;
+}
+
+template <int Lanes>
+bool EnsembleModel<Lanes>::hasReachedBoundary(int k) const {
+    // As BasicModel::hasReachedBoundary
+    const int N = members[k].gridSize;
+    const int margin = members[k].boundaryMargin;
+    const int radius = N - 1 - N / 2;
+    const Extent& extent = crystalExtent[k];
+    return extent.minRow < margin || extent.maxRow >= N - margin ||
+           extent.minCol < margin || extent.maxCol >= N - margin ||
+           (hexagonal && crystalReach[k] > radius - margin);
+}
+
+template <int Lanes>
+ModelProgress EnsembleModel<Lanes>::progress(int k) const {
+    return {stepsTaken[k], lower_bound_row, upper_bound_row, lower_bound_col, upper_bound_col,
+            ambient[k], crystalExtent[k], crystalReach[k]};
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::exportMember(int k, BasicModel<Grid>& model) const {
+    Grid& grid = model.snowflake;
+    for (int i = 0; i < rows; ++i) {
+        for (int j = domain[i].begin; j < domain[i].end; ++j) {
+            grid.setCrystal(i, j, isCrystal[i][j][k]);
+            grid.setBoundary(i, j, isBoundary[i][j][k]);
+            grid.boundaryMassAt(i, j) = boundaryMass[i][j][k];
+            grid.crystalMassAt(i, j) = crystalMass[i][j][k];
+            grid.diffusiveMassAt(i, j) = diffusiveMass[i][j][k];
+        }
+    }
+    model.resume(progress(k));
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::time_step() {
+    // Members at the boundary stop, as time_step does for a single model
+    for (int k = 0; k < Lanes; ++k) {
+        if (live[k] && hasReachedBoundary(k)) {
+            live[k] = 0;
+        }
+    }
+    if (liveCount() == 0) return;
+
+    diffusionFreezing();
+    if (symmetric) {
+        refreshGhosts();
+    }
+    for (int k = 0; k < Lanes; ++k) {
+        if (!live[k]) continue;
+        attachment(k);
+        melting(k);
+    }
+    if (noisy) {
+        noise();
+    }
+
+    for (int k = 0; k < Lanes; ++k) {
+        stepsTaken[k] += live[k];
+    }
+    stepCount++;
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::refreshGhosts() {
+    for (auto& [ghost, image] : ghosts) {
+        const bool active = image.first >= lower_bound_row && image.first < upper_bound_row &&
+                            image.second >= lower_bound_col && image.second < upper_bound_col;
+        isCrystal[ghost.first][ghost.second] = isCrystal[image.first][image.second];
+        diffusiveMass[ghost.first][ghost.second] = active ? diffusiveMass[image.first][image.second] : ambient;
+    }
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::growActiveRegion(int rowBegin, int rowEnd, int colBegin, int colEnd) {
+    rowBegin = std::max(rowBegin, origin);
+    rowEnd = std::min(rowEnd, rows);
+    colBegin = std::max(colBegin, origin);
+    colEnd = std::min(colEnd, cols);
+
+    fillFarField(rowBegin, rowEnd, colBegin, colEnd);
+
+    lower_bound_row = std::min(lower_bound_row, rowBegin);
+    upper_bound_row = std::max(upper_bound_row, rowEnd);
+    lower_bound_col = std::min(lower_bound_col, colBegin);
+    upper_bound_col = std::max(upper_bound_col, colEnd);
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::fillFarField(int rowBegin, int rowEnd, int colBegin, int colEnd) {
+    // Retired members keep the far-field value they retired with, which is
+    // what their cells outside the region stand for
+    rowBegin = std::max(rowBegin, 0);
+    rowEnd = std::min(rowEnd, rows);
+    colBegin = std::max(colBegin, 0);
+    colEnd = std::min(colEnd, cols);
+
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        const int begin = std::max(colBegin, domain[i].begin);
+        const int end = std::min(colEnd, domain[i].end);
+        const bool rowOutside = i < lower_bound_row || i >= upper_bound_row;
+        for (int j = begin; j < end; ++j) {
+            if (rowOutside || j < lower_bound_col || j >= upper_bound_col) {
+                diffusiveMass[i][j] = ambient;
+            }
+        }
+    }
+}
+
+template <int Lanes>
+bool EnsembleModel<Lanes>::isFarField(int i, int j) const {
+    const Flags& crystal = isCrystal[i][j];
+    const Flags& boundary = isBoundary[i][j];
+    const Floats& mass = diffusiveMass[i][j];
+    bool farField = true;
+    for (int k = 0; k < Lanes; ++k) {
+        farField &= !crystal[k] && !boundary[k] && mass[k] == ambient[k];
+    }
+    return farField;
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::shrinkActiveRegion() {
+    auto farFieldRow = [&](int i) {
+        const int end = colEnd(i);
+        for (int j = colBegin(i); j < end; ++j) {
+            if (!isFarField(i, j)) return false;
+        }
+        return true;
+    };
+    auto farFieldCol = [&](int j) {
+        for (int i = lower_bound_row; i < upper_bound_row; ++i) {
+            if (j >= colBegin(i) && j < colEnd(i) && !isFarField(i, j)) return false;
+        }
+        return true;
+    };
+
+    while (farFieldRow(lower_bound_row)) ++lower_bound_row;
+    while (farFieldRow(upper_bound_row - 1)) --upper_bound_row;
+    while (farFieldCol(lower_bound_col)) ++lower_bound_col;
+    while (farFieldCol(upper_bound_col - 1)) --upper_bound_col;
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::diffusionFreezing() {
+    // As beginDiffusion, the fused sweep and endDiffusion of BasicModel
+    fillFarField(lower_bound_row - 2, upper_bound_row + 2, lower_bound_col - 2, upper_bound_col + 2);
+    growActiveRegion(lower_bound_row - 1, upper_bound_row + 1, lower_bound_col - 1, upper_bound_col + 1);
+    if (symmetric) {
+        refreshGhosts();
+    }
+
+    for (int k = 0; k < Lanes; ++k) {
+        retired[k] = !live[k];
+    }
+    for (int i = lower_bound_row; i < upper_bound_row; ++i) {
+        diffuseRow(i);
+    }
+    for (int k = 0; k < Lanes; ++k) {
+        if (live[k]) {
+            freezing(k);
+        }
+    }
+
+    std::swap(diffusiveMass, nextDiffusiveMass);
+    for (int k = 0; k < Lanes; ++k) {
+        const float farFieldPair = ambient[k] + ambient[k];
+        const float next = Grid::vaporStep(kernelWeight * stencilSum(ambient[k], farFieldPair, farFieldPair, farFieldPair));
+        ambient[k] = live[k] ? next : ambient[k];
+    }
+
+    shrinkActiveRegion();
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::diffuseRow(int i) {
+    const StencilRows stencil = {
+        diffusiveMass[i - 1]->data(), diffusiveMass[i]->data(), diffusiveMass[i + 1]->data(),
+        isCrystal[i - 1]->data(), isCrystal[i]->data(), isCrystal[i + 1]->data(),
+        nextDiffusiveMass[i]->data()
+    };
+    diffuseLanes(stencil, colBegin(i), colEnd(i), kernelWeight, Lanes, retired.data());
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::freezing(int k) {
+    // The frontier holds exactly the boundary sites that aren't crystal, so
+    // this freezes what the fused sweep would, in the new vapor
+    for (const Point& site : frontier[k]) {
+        float& next = nextDiffusiveMass[site.first][site.second][k];
+        crystalMass[site.first][site.second][k] += kappa[k] * next;
+        boundaryMass[site.first][site.second][k] += (1.0f - kappa[k]) * next;
+        next = 0.0f;
+    }
+}
+
+template <int Lanes>
+bool EnsembleModel<Lanes>::attaches(int k, int i, int j) const {
+    // BasicModel::attaches for member k. The knife-edge test needs no regime:
+    // it can't pass when theta <= 0 or alpha >= 1.
+    int attachedNeighbors = 0;
+    for (auto& neighbor : neighbors) {
+        const int x = i + neighbor.first;
+        const int y = j + neighbor.second;
+        if (domain.contains(x, y) && isCrystal[x][y][k]) {
+            attachedNeighbors++;
+        }
+    }
+    if (attachedNeighbors == 0) return false;
+
+    const float mass = boundaryMass[i][j][k];
+    if (attachedNeighbors == 1 || attachedNeighbors == 2) {
+        return mass >= beta[k];
+    } else if (attachedNeighbors == 3) {
+        if (mass >= 1.0f) {
+            return true;
+        }
+
+        auto contribution = [&](const Point& neighbor) {
+            const int x = i + neighbor.first;
+            const int y = j + neighbor.second;
+            if (domain.contains(x, y) && !isCrystal[x][y][k]) {
+                return diffusiveMass[x][y][k];
+            }
+            return 0.0f;
+        };
+        const float neighbourhoodDiffusiveMass = stencilSum(diffusiveMass[i][j][k],
+            contribution(neighbors[0]) + contribution(neighbors[5]),
+            contribution(neighbors[1]) + contribution(neighbors[4]),
+            contribution(neighbors[2]) + contribution(neighbors[3]));
+        return neighbourhoodDiffusiveMass < theta[k] && mass >= alpha[k];
+    }
+    return true;
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::attachment(int k) {
+    // BasicModel::attachment for member k: decide on the whole frontier
+    // first, then mark the new boundary and crystal sites
+    attached.clear();
+    nextFrontier.clear();
+    for (const Point& site : frontier[k]) {
+        if (attaches(k, site.first, site.second)) {
+            attached.push_back(site);
+            crystalMass[site.first][site.second][k] += boundaryMass[site.first][site.second][k];
+            boundaryMass[site.first][site.second][k] = 0.0f;
+        } else {
+            nextFrontier.push_back(site);
+        }
+    }
+
+    for (const Point& site : attached) {
+        growActiveRegion(site.first - 1, site.first + 2, site.second - 1, site.second + 2);
+
+        for (auto& neighbor : neighbors) {
+            const int x = site.first + neighbor.first;
+            const int y = site.second + neighbor.second;
+            if (!domain.contains(x, y)) continue;
+
+            const Point marked = canonical(x, y);
+            if (!isCrystal[marked.first][marked.second][k] && !isBoundary[marked.first][marked.second][k]) {
+                isBoundary[marked.first][marked.second][k] = 1;
+                nextFrontier.push_back(marked);
+                if (symmetric) {
+                    growActiveRegion(marked.first - 1, marked.first + 2, marked.second - 1, marked.second + 2);
+                }
+            }
+        }
+    }
+
+    Extent& extent = crystalExtent[k];
+    for (const Point& site : attached) {
+        isCrystal[site.first][site.second][k] = 1;
+
+        const int a = site.first - center.first;
+        const int b = site.second - center.second;
+        crystalReach[k] = std::max({crystalReach[k], std::abs(a), std::abs(b), std::abs(a - b)});
+
+        if (symmetric) {
+            const int mid = members[k].gridSize / 2;
+            extent.minRow = extent.minCol = mid - crystalReach[k];
+            extent.maxRow = extent.maxCol = mid + crystalReach[k];
+            continue;
+        }
+        extent.minRow = std::min(extent.minRow, site.first);
+        extent.maxRow = std::max(extent.maxRow, site.first);
+        extent.minCol = std::min(extent.minCol, site.second);
+        extent.maxCol = std::max(extent.maxCol, site.second);
+    }
+
+    std::swap(frontier[k], nextFrontier);
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::melting(int k) {
+    // BasicModel::frontierMelting for member k
+    for (const Point& site : frontier[k]) {
+        float& quasiLiquid = boundaryMass[site.first][site.second][k];
+        const float meltedBoundary = mu[k] * quasiLiquid;
+        quasiLiquid -= meltedBoundary;
+
+        if (gamma[k] != 0.0f) {
+            float& crystal = crystalMass[site.first][site.second][k];
+            const float meltedCrystal = gamma[k] * crystal;
+            crystal -= meltedCrystal;
+            diffusiveMass[site.first][site.second][k] += meltedBoundary + meltedCrystal;
+        } else {
+            diffusiveMass[site.first][site.second][k] += meltedBoundary;
+        }
+    }
+}
+
+template <int Lanes>
+void EnsembleModel<Lanes>::noise() {
+    // BasicModel::noise for every member at once; members without noise, or
+    // retired, are scaled by exactly 1. All members share the seed, hence the bits.
+    growActiveRegion(0, rows, 0, cols);
+
+    Floats low, high;
+    for (int k = 0; k < Lanes; ++k) {
+        low[k] = live[k] ? noiseLow[k] : 1.0f;
+        high[k] = live[k] ? noiseHigh[k] : 1.0f;
+    }
+
+    const uint32_t seed = members.front().seed;
+    const int mid = members.front().gridSize / 2;
+    const int colOffset = mid - center.second;
+    for (int i = lower_bound_row; i < upper_bound_row; ++i) {
+        NoiseBits bits(seed, stepCount, i - center.first + mid);
+        const int end = colEnd(i);
+        for (int j = colBegin(i); j < end; ++j) {
+            const Floats& factors = bits(j + colOffset) ? high : low;
+            Floats& mass = diffusiveMass[i][j];
+            for (int k = 0; k < Lanes; ++k) {
+                mass[k] *= factors[k];
+            }
+        }
+    }
+}
+
+#endif // GG_ENSEMBLE_H
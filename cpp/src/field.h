@@ -0,0 +1,123 @@
+#ifndef GG_FIELD_H
+#define GG_FIELD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+// Allocator handing out cache-line aligned blocks
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(CACHE_LINE_SIZE)));
+    }
+    void deallocate(T* p, std::size_t) {
+        ::operator delete(p, std::align_val_t(CACHE_LINE_SIZE));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+// Columns [begin, end) of one row
+struct RowExtent {
+    int begin, end;
+};
+
+// 2D field stored in a single allocation. Rows are padded so that each one
+// starts on a cache line; field[i] returns a pointer to row i, so field[i][j]
+// indexes the same way the old vector-of-vector grids did.
+//
+// Rows may cover different column ranges, in which case only those columns
+// are stored. An optional halo of `halo` cells on every side of every row (and
+// `halo` extra rows) holds `haloValue`, which lets stencils read field[i - 1][j]
+// or field[i][end] without bounds checks.
+template <typename T>
+class Field {
+    public:
+        Field() = default;
+        Field(int rows, int cols, T value = T(), int halo = 0, T haloValue = T());
+        Field(const std::vector<RowExtent>& extents, T value = T(), int halo = 0, T haloValue = T());
+
+        T* operator[](int i) { return storage.data() + rowOrigin[i + halo]; }
+        const T* operator[](int i) const { return storage.data() + rowOrigin[i + halo]; }
+        T& operator()(int i, int j) { return (*this)[i][j]; }
+        const T& operator()(int i, int j) const { return (*this)[i][j]; }
+
+        int rows() const { return static_cast<int>(extents.size()); }
+        const RowExtent& extent(int i) const { return extents[i]; }
+
+        // Fills the cells inside the field, leaving the halo alone
+        void fill(T value);
+    private:
+        std::vector<T, AlignedAllocator<T>> storage;
+        std::vector<RowExtent> extents;
+        std::vector<std::ptrdiff_t> rowOrigin;  // Offset of column 0 of row i - halo
+        int halo = 0;
+};
+
+template <typename T>
+Field<T>::Field(int rows, int cols, T value, int halo, T haloValue)
+    : Field(std::vector<RowExtent>(rows, RowExtent{0, cols}), value, halo, haloValue) {}
+
+template <typename T>
+Field<T>::Field(const std::vector<RowExtent>& extents, T value, int halo, T haloValue)
+    : extents(extents), halo(halo) {
+    const int rows = static_cast<int>(extents.size());
+    const int perLine = std::max(1, static_cast<int>(CACHE_LINE_SIZE / sizeof(T)));
+
+    // A row's halo has to cover what stencils on the rows next to it read,
+    // so it spans the extents of all rows within `halo` of it
+    std::vector<RowExtent> stored(rows + 2 * halo);
+    for (int i = -halo; i < rows + halo; ++i) {
+        RowExtent& range = stored[i + halo];
+        range = {0, 0};
+        bool empty = true;
+        for (int k = std::max(i - halo, 0); k <= std::min(i + halo, rows - 1); ++k) {
+            if (extents[k].begin >= extents[k].end) continue;
+            range.begin = empty ? extents[k].begin : std::min(range.begin, extents[k].begin);
+            range.end = empty ? extents[k].end : std::max(range.end, extents[k].end);
+            empty = false;
+        }
+        if (!empty) {
+            range.begin -= halo;
+            range.end += halo;
+        }
+    }
+
+    // A halo to the left takes a whole cache line so the first column stays
+    // aligned. Round each row up to a whole number of cache lines.
+    const int leftPadding = halo > 0 ? (halo + perLine - 1) / perLine * perLine : 0;
+    rowOrigin.resize(rows + 2 * halo);
+    std::size_t size = 0;
+    for (int k = 0; k < rows + 2 * halo; ++k) {
+        const int first = stored[k].begin + halo;
+        rowOrigin[k] = static_cast<std::ptrdiff_t>(size) + leftPadding - first;
+        size += (leftPadding + (stored[k].end - first) + perLine - 1) / perLine * perLine;
+    }
+
+    storage.assign(size, halo > 0 ? haloValue : value);
+    if (halo > 0) {
+        fill(value);
+    }
+}
+
+template <typename T>
+void Field<T>::fill(T value) {
+    for (int i = 0; i < rows(); ++i) {
+        std::fill((*this)[i] + extents[i].begin, (*this)[i] + extents[i].end, value);
+    }
+}
+
+#endif // GG_FIELD_H
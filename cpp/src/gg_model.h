@@ -1,12 +1,17 @@
 #ifndef GG_MODEL_H
 #define GG_MODEL_H
 
+#include "grid.h"
+#include "diffusion_kernels.h"
+#include "noise.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <memory>
+#include <type_traits>
 #include <vector>
 #include <cmath>
-
-using FloatGrid = std::vector<std::vector<float>>;
-using IntGrid = std::vector<std::vector<int>>;
-using Point = std::pair<int, int>;
+#include <cstdlib>
 
 struct ModelSettings {
     int gridSize;
@@ -16,41 +21,194 @@ struct ModelSettings {
     float mu;       // Melting rate for boundary mass
     float gamma;    // Melting rate for crystal mass
     float theta;    // Diffusive mass threshold for knife-edge instability
-    float sigma;    // Noise parameter NOT WORKING
+    float sigma;    // Noise: every step scales each diffusive mass by 1 + sigma or 1 - sigma
     float alpha;    // Reduced boundary mass threshold when diffusive mass < theta
-    bool useSymmetry = false;  // Toggle wedge-only computation (EXPERIMENTAL - may have bugs)
+    uint32_t seed = 1;  // Picks the noise (see noise.h)
+    bool useSymmetry = false;  // Compute a 1/12 wedge and mirror it (same results while sigma == 0)
+    bool hexDomain = false;    // Only store the hexagon inscribed in the grid (implied by useSymmetry)
     int boundaryMargin = 2;
+    int vaporHalo = 0;  // Cells kept active around the crystal (0 = follow the vapor exactly)
+    bool fusedStep = false;    // Fused time step instead of four full phases (same results)
+    bool simdDiffusion = true; // Vectorized diffusion kernel (Grid and CompactGrid, same results)
+    int threads = 1;           // Threads used by time_step (same results for any count)
+};
+
+// The parameters one time step uses, copied out of the settings at its start:
+// the UI may change the settings between steps, but never during one
+struct StepParameters {
+    float kappa, mu, gamma;
+    float beta, theta, alpha;
+    float sigma;
+};
+
+inline bool operator==(const StepParameters& a, const StepParameters& b) {
+    return a.kappa == b.kappa && a.mu == b.mu && a.gamma == b.gamma &&
+           a.beta == b.beta && a.theta == b.theta && a.alpha == b.alpha && a.sigma == b.sigma;
+}
+
+// Terms of the update that some parameter values switch off. Each step runs
+// a version of the phases compiled for the current regime, without them.
+template <bool CrystalMelting, bool KnifeEdge, bool Noise>
+struct StepRegime {
+    static constexpr bool crystalMelting = CrystalMelting;  // gamma != 0
+    static constexpr bool knifeEdge = KnifeEdge;            // theta > 0 and alpha < 1
+    static constexpr bool noise = Noise;                    // sigma != 0
+};
+
+// Bounding box of the crystal, inclusive
+struct Extent {
+    int minRow, maxRow;
+    int minCol, maxCol;
 };
 
-struct Grid {
-    IntGrid isCrystal;
-    FloatGrid boundaryMass;
-    FloatGrid crystalMass;
-    FloatGrid diffusiveMass;
+// Where a run stands, besides the grid and the settings: enough to carry on
+// from a copy of the grid exactly as if it had never stopped
+struct ModelProgress {
+    uint64_t steps;
+    int lowerRow, upperRow, lowerCol, upperCol;     // Active region
+    float ambient;
+    Extent crystalExtent;
+    int crystalReach;
 };
 
-class Model {
+// Cells of the gridSize x gridSize grid the model simulates
+inline Domain gridDomain(const ModelSettings& settings) {
+    return settings.hexDomain || settings.useSymmetry ? Domain::hexagon(settings.gridSize)
+                                                      : Domain::square(settings.gridSize);
+}
+
+// Layout is one of the cell layouts from grid.h (Grid, PackedGrid or
+// CompactGrid). With CompactGrid the vapor is rounded to 16 bits on every
+// store, and so is the far-field value (see vaporStep).
+//
+// Only the active region [lower_bound_row, upper_bound_row) x
+// [lower_bound_col, upper_bound_col) is swept. Every cell outside of it is in
+// the far-field state: no crystal, no boundary, no boundary or crystal mass and
+// a diffusive mass of exactly `ambient`. Diffusion of a uniform field is done
+// in closed form, so the region only grows where the vapor actually differs
+// from the far field, and wherever attachment adds crystal. Noise (sigma > 0)
+// perturbs every cell, so once it is on the whole grid is active.
+//
+// The grid is either the whole square or, with hexDomain, the hexagon inside
+// it. Rows of the hexagon cover different columns; the sweeps clip every row
+// to the columns it stores (colBegin/colEnd).
+//
+// With useSymmetry, snowflake only holds the wedge 0 <= 2b <= a of the
+// hexagon, where (a, b) is the offset from the seed, stored at (a + 1, b + 1).
+// The twelve symmetries of the hex lattice map it onto the rest of the grid.
+// Cells just outside the wedge are ghosts that copy their mirror image before
+// anything reads them, so the phases run unchanged on the wedge rows. The
+// stencil sums are symmetric (see stencilSum), so this matches the full
+// hexagon bit for bit. With noise, every image of a wedge cell is perturbed
+// the same way, so the snowflake stays symmetric.
+template <typename Layout>
+class BasicModel {
     public:
-        Model(ModelSettings&);
+        BasicModel(ModelSettings&);
         void initialize();
         void time_step();
         bool hasReachedBoundary() const;
-        Grid snowflake;
+        const Extent& getCrystalExtent() const { return crystalExtent; }    // In full grid coordinates
+        // Bounding box, in full grid coordinates, of the cells that may differ
+        // from the far field: after syncFarField every other cell holds ambient
+        // vapor and nothing else. Lets a renderer skip the rest.
+        Extent activeExtent() const;
+        // Cells outside the active region hold stale diffusive mass until this
+        // writes the far-field value back to them (call before reading the grid)
+        void syncFarField();
+        // Vapor of cell (i, j) of snowflake, without a syncFarField
+        float vaporAt(int i, int j) const;
+        // Sets the vapor of cell (i, j) of snowflake, growing the active region
+        // to take it in. Lets a caller impose vapor between steps, e.g. along
+        // the edge of the grid (see multires.h).
+        void setVapor(int i, int j, float mass);
+        // The whole grid (see gridDomain): snowflake itself, or in symmetric
+        // mode a copy rebuilt from the wedge on every call
+        const Layout& fullGrid();
+        const ModelSettings& getSettings() const { return *settings; }
+        // Checkpointing: progress() with snowflake is the whole state. To
+        // resume, initialize, refill snowflake, then call resume()
+        ModelProgress progress() const;
+        void resume(const ModelProgress&);
+        Layout snowflake;
+        PhaseTimes phaseTimes;  // Filled in with -DGG_PHASE_TIMING (see phase_timing.h)
+        TraceRing<StepRecord> stepTrace;    // Filled in with -DGG_TRACE (see trace.h)
     private:
         const float kernelWeight = 1.0f / 7.0f;
+        int rows, cols;     // Bounding box of snowflake.domain
         int lower_bound_row, upper_bound_row;
         int lower_bound_col, upper_bound_col;
-        
+        float ambient;  // Diffusive mass of every cell outside the active region
+        Extent crystalExtent;   // Grown by attachment()
+        int crystalReach;       // Hex steps from the seed to the farthest crystal site
+        uint64_t stepCount;     // Steps since initialize(), keys the noise
+
+        void growActiveRegion(int rowBegin, int rowEnd, int colBegin, int colEnd);
+        void fillFarField(int rowBegin, int rowEnd, int colBegin, int colEnd);
+        bool isFarField(int i, int j) const;
+        void shrinkActiveRegion();
+        int colBegin(int i) const;
+        int colEnd(int i) const;
+        size_t activeCellCount() const;
+
+        bool hexagonal = false; // Hexagonal domain (hexDomain or useSymmetry, read by initialize())
+
+        // Symmetric mode (useSymmetry, read by initialize())
+        bool symmetric = false;
+        int origin = 0;     // First row and column that isn't a ghost
+        std::vector<std::pair<Point, Point>> ghosts;    // Ghost and its image in the wedge
+        Layout fullSnowflake;
+        Point canonical(int i, int j) const;
+        void refreshGhosts();
+
+        // Steps are dispatched to the version of the phases for the current
+        // parameter regime, picked again whenever the parameters change
+        using StepFunction = void (BasicModel::*)(const StepParameters&);
+        StepParameters stepParameters;
+        StepFunction stepFunction = nullptr;
+        static StepFunction selectStep(const StepParameters&);
+        template <typename Regime>
+        void step(const StepParameters&);
+
         void diffusion();
-        void freezing();
-        void attachment();
-        void melting();
+        void freezing(const StepParameters&);
+        template <typename Regime>
+        void attachment(const StepParameters&);
+        template <typename Regime>
+        void melting(const StepParameters&);
+        template <typename Regime>
+        bool attaches(int i, int j, const StepParameters&) const;
+
+        // Fused step: one sweep for diffusion and freezing, then attachment
+        // and melting over the frontier only
+        void fusedDiffusionFreezing(const StepParameters&);
+        template <typename Regime>
+        void frontierMelting(const StepParameters&);
+        template <typename Regime>
+        void meltSite(int i, int j, float mu, float gamma);
+        void noise(const StepParameters&);
+
+        void beginDiffusion();
+        void endDiffusion();
+        void diffuseRow(int i);
+        float diffusedMass(int i, int j) const;
+        DiffuseRowKernel diffuseRowKernel = selectDiffuseRowKernel();
+
+        // Row bands (or frontier chunks) smaller than this run on one thread
+        static constexpr int MIN_ROWS_PER_BAND = 16;
+        static constexpr int MIN_SITES_PER_BAND = 256;
+        std::unique_ptr<ThreadPool> pool;
+        std::vector<std::vector<Point>> bandAttached, bandFrontier;
+        template <typename Function>
+        int parallelFor(int begin, int end, int minPerBand, Function function);
 
         ModelSettings* settings;
         Point center;
-        FloatGrid intermediateDiffusiveMass;
-        IntGrid isBoundary;
-        
+        std::vector<Point> attached;    // Sites attaching in the current step
+        // Boundary sites that are not crystal yet, double buffered so that
+        // attachment() runs without allocating once the buffers have grown
+        std::vector<Point> frontier, nextFrontier;
+
         const std::vector<Point> neighbors = {
             {-1, -1}, {-1, 0},
             {0, -1}, {0, 1},
@@ -58,238 +216,946 @@ class Model {
         };
 };
 
-Model::Model(ModelSettings& settings) : settings(&settings) {
+// Storage for the symmetric wedge of the hexagon (see BasicModel): offsets
+// a = -1..R from the seed, each row running from the ghost at b = -1 to the
+// ghost just past 2b = a. The last row's b = -1 ghost would mirror a cell
+// outside the hexagon, so it is left off the grid.
+inline Domain wedgeDomain(int N) {
+    const int radius = N - 1 - N / 2;
+    Domain domain = {std::vector<RowExtent>(radius + 2)};
+    domain.extents[0] = {0, 2};
+    for (int i = 1; i < radius + 2; ++i) {
+        domain.extents[i] = {i <= radius ? 0 : 1, (i + 3) / 2 + 1};
+    }
+    return domain;
+}
+
+// Image in the wedge of cell (i, j), for a wedge whose seed is at center
+inline Point wedgeImage(Point center, int i, int j) {
+    int a = i - center.first;
+    int b = j - center.second;
+    if (a == 0 && b == 0) return center;
+
+    // Rotate by 60 degrees, (a, b) -> (a - b, a), into the sector 0 <= b < a,
+    // then reflect the half beyond 2b = a back onto the wedge
+    while (!(b >= 0 && a > b)) {
+        const int rotated = a - b;
+        b = a;
+        a = rotated;
+    }
+    if (2 * b > a) {
+        b = a - b;
+    }
+    return {center.first + a, center.second + b};
+}
+
+// Every cell next to the wedge that lies outside of it is a ghost, paired
+// with its image in the wedge, sorted
+inline std::vector<std::pair<Point, Point>> wedgeGhosts(const Domain& wedge, Point center) {
+    const Point neighbors[] = {{-1, -1}, {-1, 0}, {0, -1}, {0, 1}, {1, 0}, {1, 1}};
+    std::vector<std::pair<Point, Point>> ghosts;
+    for (int i = center.first; i < wedge.rows(); ++i) {
+        for (int j = center.second; j < (i + 3) / 2; ++j) {
+            for (auto& neighbor : neighbors) {
+                const int x = i + neighbor.first;
+                const int y = j + neighbor.second;
+                const Point image = wedgeImage(center, x, y);
+                if (wedge.contains(x, y) && image != Point{x, y}) {
+                    ghosts.push_back({{x, y}, image});
+                }
+            }
+        }
+    }
+    std::sort(ghosts.begin(), ghosts.end());
+    ghosts.erase(std::unique(ghosts.begin(), ghosts.end()), ghosts.end());
+    return ghosts;
+}
+
+// Compile with -DGG_PACKED_LAYOUT to run the array-of-structs layout, or with
+// -DGG_HALF_MASS / -DGG_FIXED_MASS for 16-bit masses (see precision.h), or
+// with -DGG_TILED_GRID to only allocate the tiles around the crystal
+#if defined(GG_PACKED_LAYOUT)
+using Model = BasicModel<PackedGrid>;
+#elif defined(GG_TILED_GRID)
+using Model = BasicModel<TiledGrid>;
+#elif defined(GG_HALF_MASS)
+using Model = BasicModel<CompactGrid<HalfPrecision>>;
+#elif defined(GG_FIXED_MASS)
+using Model = BasicModel<CompactGrid<FixedPrecision>>;
+#else
+using Model = BasicModel<Grid>;
+#endif
+
+template <typename Layout>
+BasicModel<Layout>::BasicModel(ModelSettings& settings) : settings(&settings) {
     initialize();
 }
 
-void Model::initialize() {
-    center = {settings->gridSize / 2, settings->gridSize / 2};
-    lower_bound_row = 0;
-    upper_bound_row = settings->gridSize;
-    lower_bound_col = 0;
-    upper_bound_col = settings->gridSize;
-
-    snowflake.isCrystal = IntGrid(settings->gridSize, std::vector<int>(settings->gridSize, 0));
-    snowflake.boundaryMass = FloatGrid(settings->gridSize, std::vector<float>(settings->gridSize, 0.0));
-    snowflake.crystalMass = FloatGrid(settings->gridSize, std::vector<float>(settings->gridSize, 0.0));
-    snowflake.diffusiveMass = FloatGrid(settings->gridSize, std::vector<float>(settings->gridSize, settings->rho));
-    intermediateDiffusiveMass = FloatGrid(settings->gridSize, std::vector<float>(settings->gridSize, 0.0));
-    isBoundary = IntGrid(settings->gridSize, std::vector<int>(settings->gridSize, 0));
-    
+template <typename Layout>
+void BasicModel<Layout>::initialize() {
+    const int N = settings->gridSize;
+    symmetric = settings->useSymmetry;
+    hexagonal = settings->hexDomain || settings->useSymmetry;
+    origin = symmetric ? 1 : 0;
+    center = symmetric ? Point{origin, origin} : Point{N / 2, N / 2};
+    ambient = Layout::vaporStep(settings->rho);
+
+#ifdef GG_HAS_THREADS
+    if (settings->threads > 1 && (!pool || pool->size() != settings->threads)) {
+        pool = std::make_unique<ThreadPool>(settings->threads);
+    } else if (settings->threads <= 1) {
+        pool.reset();
+    }
+#endif
+
+    snowflake.initialize(symmetric ? wedgeDomain(N) : gridDomain(*settings), settings->rho);
+    rows = snowflake.domain.rows();
+    cols = 0;
+    for (auto& extent : snowflake.domain.extents) {
+        cols = std::max(cols, extent.end);
+    }
+
+    // Only the seed and its neighbors differ from the far field
+    lower_bound_row = std::max(center.first - 1, origin);
+    upper_bound_row = center.first + 2;
+    lower_bound_col = std::max(center.second - 1, origin);
+    upper_bound_col = center.second + 2;
+    if constexpr (isTiledGrid<Layout>) {
+        snowflake.cover(lower_bound_row, upper_bound_row, lower_bound_col, upper_bound_col);
+    }
+    crystalExtent = {N / 2, N / 2, N / 2, N / 2};
+    crystalReach = 0;
+    stepCount = 0;
+
     // Initial crystal seed
-    snowflake.isCrystal[center.first][center.second] = 1;
-    snowflake.crystalMass[center.first][center.second] = 1.0;
-    snowflake.diffusiveMass[center.first][center.second] = 0.0;
+    snowflake.setCrystal(center.first, center.second, true);
+    snowflake.crystalMassAt(center.first, center.second) = 1.0;
+    snowflake.diffusiveMassAt(center.first, center.second) = 0.0;
+    frontier.clear();
     for (auto& neighbor : neighbors) {
-        isBoundary[center.first + neighbor.first][center.second + neighbor.second] = 1;
+        // All six neighbors share one image in the wedge
+        const Point site = canonical(center.first + neighbor.first, center.second + neighbor.second);
+        if (!snowflake.isBoundaryAt(site.first, site.second)) {
+            snowflake.setBoundary(site.first, site.second, true);
+            frontier.push_back(site);
+        }
+    }
+
+    ghosts.clear();
+    if (symmetric) {
+        ghosts = wedgeGhosts(snowflake.domain, center);
     }
 }
 
-bool Model::hasReachedBoundary() const {
-    const int N = settings->gridSize;
-    const int margin = settings->boundaryMargin;
-    
-    for (int i = 0; i < N; ++i) {
-        for (int j = 0; j < N; ++j) {
-            if (snowflake.isCrystal[i][j]) {
-                if (i < margin || i >= N - margin || 
-                    j < margin || j >= N - margin) {
-                    return true;
-                }
+template <typename Layout>
+ModelProgress BasicModel<Layout>::progress() const {
+    return {stepCount, lower_bound_row, upper_bound_row, lower_bound_col, upper_bound_col,
+            ambient, crystalExtent, crystalReach};
+}
+
+template <typename Layout>
+void BasicModel<Layout>::resume(const ModelProgress& progress) {
+    stepCount = progress.steps;
+    lower_bound_row = progress.lowerRow;
+    upper_bound_row = progress.upperRow;
+    lower_bound_col = progress.lowerCol;
+    upper_bound_col = progress.upperCol;
+    ambient = progress.ambient;
+    crystalExtent = progress.crystalExtent;
+    crystalReach = progress.crystalReach;
+    if constexpr (isTiledGrid<Layout>) {
+        // Cells refilled with the far-field value of initialize() may still
+        // be missing, so allocate the region before that value moves
+        snowflake.cover(lower_bound_row, upper_bound_row, lower_bound_col, upper_bound_col);
+        snowflake.farVapor = ambient;
+    }
+
+    // The frontier is every boundary site that isn't crystal. Its order
+    // only decides the order sites are visited in, never the outcome.
+    frontier.clear();
+    for (int i = 0; i < rows; ++i) {
+        for (int j = snowflake.domain[i].begin; j < snowflake.domain[i].end; ++j) {
+            if (snowflake.isBoundaryAt(i, j) && !snowflake.isCrystalAt(i, j)) {
+                frontier.push_back({i, j});
             }
         }
     }
-    
-    return false;
 }
 
-void Model::time_step() {
-    // Skip simulation if crystal has reached the boundary
-    if (hasReachedBoundary()) {
-        return;
+template <typename Layout>
+Point BasicModel<Layout>::canonical(int i, int j) const {
+    // Image of (i, j) in the wedge
+    return symmetric ? wedgeImage(center, i, j) : Point{i, j};
+}
+
+template <typename Layout>
+void BasicModel<Layout>::refreshGhosts() {
+    // Images outside the active region are far field, whatever they hold
+    for (auto& [ghost, image] : ghosts) {
+        const bool active = image.first >= lower_bound_row && image.first < upper_bound_row &&
+                            image.second >= lower_bound_col && image.second < upper_bound_col;
+        snowflake.setCrystal(ghost.first, ghost.second, snowflake.isCrystalAt(image.first, image.second));
+        snowflake.diffusiveMassAt(ghost.first, ghost.second) =
+            active ? snowflake.diffusiveMassAt(image.first, image.second) : ambient;
     }
-    
-    diffusion();
-    freezing();
-    attachment();
-    melting();
 }
 
-void Model::diffusion() {
-    const int N = settings->gridSize;
-    
+template <typename Layout>
+int BasicModel<Layout>::colBegin(int i) const {
+    // Start of row i of the active region, clipped to the domain
+    return std::max(lower_bound_col, snowflake.domain[i].begin);
+}
+
+template <typename Layout>
+int BasicModel<Layout>::colEnd(int i) const {
+    // End of row i of the active region, clipped to the domain, which in
+    // symmetric mode ends with a ghost
+    return std::min(upper_bound_col, snowflake.domain[i].end - (symmetric ? 1 : 0));
+}
+
+template <typename Layout>
+size_t BasicModel<Layout>::activeCellCount() const {
+    size_t cells = 0;
     for (int i = lower_bound_row; i < upper_bound_row; ++i) {
-        for (int j = lower_bound_col; j < upper_bound_col; ++j) {
-            // Crystal sites have no diffusive mass
-            if (snowflake.isCrystal[i][j]) {
-                intermediateDiffusiveMass[i][j] = 0.0;
-                continue;
+        cells += std::max(colEnd(i) - colBegin(i), 0);
+    }
+    return cells;
+}
+
+template <typename Layout>
+const Layout& BasicModel<Layout>::fullGrid() {
+    if (!symmetric) return snowflake;
+
+    const int N = settings->gridSize;
+    const Domain domain = gridDomain(*settings);
+    if (fullSnowflake.domain.rows() != N) {
+        fullSnowflake.initialize(domain, ambient);
+    }
+
+    // Far field everywhere, then every wedge cell is copied to its images
+    if constexpr (isTiledGrid<Layout>) {
+        fullSnowflake.clear(ambient);
+    } else {
+        for (int i = 0; i < N; ++i) {
+            for (int j = domain[i].begin; j < domain[i].end; ++j) {
+                fullSnowflake.setCrystal(i, j, false);
+                fullSnowflake.setBoundary(i, j, false);
+                fullSnowflake.boundaryMassAt(i, j) = 0.0f;
+                fullSnowflake.crystalMassAt(i, j) = 0.0f;
+                fullSnowflake.diffusiveMassAt(i, j) = ambient;
             }
-            
-            // Sum contributions from center and 6 neighbors
-            float sum = snowflake.diffusiveMass[i][j];
-            
-            for (auto& neighbor : neighbors) {
-                int x = i + neighbor.first;
-                int y = j + neighbor.second;
-                
-                // Boundary check - clamp instead of wrap (removed modulo)
-                if (x < 0 || x >= N || y < 0 || y >= N) {
-                    // Reflecting boundary: use current cell's value
-                    sum += snowflake.diffusiveMass[i][j];
-                } else if (snowflake.isCrystal[x][y]) {
-                    // Reflecting boundary: use current cell's value instead of crystal neighbor
-                    sum += snowflake.diffusiveMass[i][j];
-                } else {
-                    // Normal diffusion from non-crystal neighbor
-                    sum += snowflake.diffusiveMass[x][y];
+        }
+    }
+
+    for (int i = origin; i < rows; ++i) {
+        for (int j = origin; j < (i + 3) / 2; ++j) {
+            const bool active = i >= lower_bound_row && i < upper_bound_row &&
+                                j >= lower_bound_col && j < upper_bound_col;
+            if (!active) continue;
+
+            // Six rotations of the cell and of its reflection (a, b) -> (b, a)
+            Point images[2] = {{i - center.first, j - center.second}, {j - center.second, i - center.first}};
+            for (int k = 0; k < 6; ++k) {
+                for (auto& image : images) {
+                    const int x = N / 2 + image.first;
+                    const int y = N / 2 + image.second;
+                    if (domain.contains(x, y)) {
+                        fullSnowflake.setCrystal(x, y, snowflake.isCrystalAt(i, j));
+                        fullSnowflake.setBoundary(x, y, snowflake.isBoundaryAt(i, j));
+                        fullSnowflake.boundaryMassAt(x, y) = snowflake.boundaryMassAt(i, j);
+                        fullSnowflake.crystalMassAt(x, y) = snowflake.crystalMassAt(i, j);
+                        fullSnowflake.diffusiveMassAt(x, y) = snowflake.diffusiveMassAt(i, j);
+                    }
+                    image = {image.first - image.second, image.first};
                 }
             }
-            
-            intermediateDiffusiveMass[i][j] = kernelWeight * sum;
         }
     }
-    
-    std::swap(snowflake.diffusiveMass, intermediateDiffusiveMass);
+    return fullSnowflake;
 }
 
-void Model::freezing() {
-    for (int i = lower_bound_row; i < upper_bound_row; ++i) {
-        for (int j = lower_bound_col; j < upper_bound_col; ++j) {
-            // Ensure crystal sites have no diffusive mass
-            if (snowflake.isCrystal[i][j]) {
-                snowflake.diffusiveMass[i][j] = 0.0;
-                continue;
-            }
-            
-            // Only boundary sites participate in freezing
-            if (isBoundary[i][j]) {
-                // Proportion kappa crystallizes directly
-                snowflake.crystalMass[i][j] += settings->kappa * snowflake.diffusiveMass[i][j];
-                
-                // Proportion (1-kappa) becomes boundary mass (quasi-liquid)
-                snowflake.boundaryMass[i][j] += (1.0f - settings->kappa) * snowflake.diffusiveMass[i][j];
-                
-                // All diffusive mass at boundary is now converted
-                snowflake.diffusiveMass[i][j] = 0.0;
+template <typename Layout>
+Extent BasicModel<Layout>::activeExtent() const {
+    if (!symmetric) {
+        return {lower_bound_row, upper_bound_row - 1, lower_bound_col, upper_bound_col - 1};
+    }
+    // Wedge cells (a, b) have 0 <= 2b <= a, so all their images lie within
+    // a hex steps of the seed
+    const int mid = settings->gridSize / 2;
+    const int reach = upper_bound_row - 1 - center.first;
+    return {mid - reach, mid + reach, mid - reach, mid + reach};
+}
+
+template <typename Layout>
+void BasicModel<Layout>::growActiveRegion(int rowBegin, int rowEnd, int colBegin, int colEnd) {
+    rowBegin = std::max(rowBegin, origin);
+    rowEnd = std::min(rowEnd, rows);
+    colBegin = std::max(colBegin, origin);
+    colEnd = std::min(colEnd, cols);
+
+    // Newly included cells may hold stale vapor, everything else is already zero
+    fillFarField(rowBegin, rowEnd, colBegin, colEnd);
+
+    lower_bound_row = std::min(lower_bound_row, rowBegin);
+    upper_bound_row = std::max(upper_bound_row, rowEnd);
+    lower_bound_col = std::min(lower_bound_col, colBegin);
+    upper_bound_col = std::max(upper_bound_col, colEnd);
+
+    // The sweeps store into the active region from several threads, so its
+    // tiles have to be there before they start
+    if constexpr (isTiledGrid<Layout>) {
+        snowflake.cover(lower_bound_row, upper_bound_row, lower_bound_col, upper_bound_col);
+    }
+}
+
+template <typename Layout>
+void BasicModel<Layout>::fillFarField(int rowBegin, int rowEnd, int colBegin, int colEnd) {
+    // Writes the far-field vapor into the part of the (clamped) rectangle that
+    // lies outside the active region
+    rowBegin = std::max(rowBegin, 0);
+    rowEnd = std::min(rowEnd, rows);
+    colBegin = std::max(colBegin, 0);
+    colEnd = std::min(colEnd, cols);
+
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        const int begin = std::max(colBegin, snowflake.domain[i].begin);
+        const int end = std::min(colEnd, snowflake.domain[i].end);
+        if (i < lower_bound_row || i >= upper_bound_row) {
+            for (int j = begin; j < end; ++j) {
+                snowflake.diffusiveMassAt(i, j) = ambient;
             }
+            continue;
+        }
+        for (int j = begin; j < std::min(end, lower_bound_col); ++j) {
+            snowflake.diffusiveMassAt(i, j) = ambient;
+        }
+        for (int j = std::max(begin, upper_bound_col); j < end; ++j) {
+            snowflake.diffusiveMassAt(i, j) = ambient;
+        }
+    }
+}
+
+template <typename Layout>
+bool BasicModel<Layout>::isFarField(int i, int j) const {
+    // Only crystal and boundary sites ever carry crystal or boundary mass
+    return !snowflake.isCrystalAt(i, j) && !snowflake.isBoundaryAt(i, j) &&
+           snowflake.diffusiveMassAt(i, j) == ambient;
+}
+
+template <typename Layout>
+void BasicModel<Layout>::shrinkActiveRegion() {
+    // Drop outer rows and columns that have settled back to the far field.
+    // The crystal never does, so the region can't become empty.
+    auto farFieldRow = [&](int i) {
+        const int end = colEnd(i);
+        for (int j = colBegin(i); j < end; ++j) {
+            if (!isFarField(i, j)) return false;
         }
+        return true;
+    };
+    auto farFieldCol = [&](int j) {
+        for (int i = lower_bound_row; i < upper_bound_row; ++i) {
+            if (j >= colBegin(i) && j < colEnd(i) && !isFarField(i, j)) return false;
+        }
+        return true;
+    };
+
+    while (farFieldRow(lower_bound_row)) ++lower_bound_row;
+    while (farFieldRow(upper_bound_row - 1)) --upper_bound_row;
+    while (farFieldCol(lower_bound_col)) ++lower_bound_col;
+    while (farFieldCol(upper_bound_col - 1)) --upper_bound_col;
+
+    // Optionally forget the vapor beyond a fixed halo around the crystal.
+    // Boundary sites and their neighbors always stay active.
+    if (settings->vaporHalo > 0 && symmetric) {
+        // The wedge starts at the seed and reaches as far as the crystal does
+        const int halo = std::max(settings->vaporHalo, 2);
+        upper_bound_row = std::min(upper_bound_row, center.first + crystalReach + halo + 1);
+        upper_bound_col = std::min(upper_bound_col, center.second + crystalReach / 2 + halo + 1);
+    } else if (settings->vaporHalo > 0) {
+        const int halo = std::max(settings->vaporHalo, 2);
+        lower_bound_row = std::max(lower_bound_row, crystalExtent.minRow - halo);
+        upper_bound_row = std::min(upper_bound_row, crystalExtent.maxRow + halo + 1);
+        lower_bound_col = std::max(lower_bound_col, crystalExtent.minCol - halo);
+        upper_bound_col = std::min(upper_bound_col, crystalExtent.maxCol + halo + 1);
     }
 }
 
-void Model::attachment() {
+template <typename Layout>
+void BasicModel<Layout>::syncFarField() {
+    fillFarField(0, rows, 0, cols);
+}
+
+template <typename Layout>
+float BasicModel<Layout>::vaporAt(int i, int j) const {
+    const bool active = i >= lower_bound_row && i < upper_bound_row &&
+                        j >= lower_bound_col && j < upper_bound_col;
+    return active ? snowflake.diffusiveMassAt(i, j) : ambient;
+}
+
+template <typename Layout>
+void BasicModel<Layout>::setVapor(int i, int j, float mass) {
+    // The region stays a box, so it grows by all of the cells between it and (i, j)
+    const bool active = i >= lower_bound_row && i < upper_bound_row &&
+                        j >= lower_bound_col && j < upper_bound_col;
+    if (!active) {
+        growActiveRegion(std::min(i, lower_bound_row), std::max(i + 1, upper_bound_row),
+                         std::min(j, lower_bound_col), std::max(j + 1, upper_bound_col));
+    }
+    snowflake.diffusiveMassAt(i, j) = mass;
+}
+
+template <typename Layout>
+bool BasicModel<Layout>::hasReachedBoundary() const {
     const int N = settings->gridSize;
-    
-    // Use temporary grid to avoid modifying during iteration
-    IntGrid newIsBoundary = isBoundary;
-    IntGrid newIsCrystal = snowflake.isCrystal;
-    
-    for (int i = lower_bound_row; i < upper_bound_row; ++i) {
-        for (int j = lower_bound_col; j < upper_bound_col; ++j) {
-            // Skip if already crystal
-            if (snowflake.isCrystal[i][j] == 1) continue;
-            
-            // Count attached neighbors
-            int attachedNeighbors = 0;
-            for (auto& neighbor : neighbors) {
-                int x = i + neighbor.first;
-                int y = j + neighbor.second;
-                
-                // Boundary check (removed modulo)
-                if (x >= 0 && x < N && y >= 0 && y < N && snowflake.isCrystal[x][y] == 1) {
-                    attachedNeighbors++;
-                }
-            }
-            
-            // Skip if not a boundary site
-            if (attachedNeighbors == 0) continue;
-            
-            bool shouldAttach = false;
-            
-            // Case 1 & 2: Tips and flat spots (1 or 2 attached neighbors)
-            if (attachedNeighbors == 1 || attachedNeighbors == 2) {
-                if (snowflake.boundaryMass[i][j] >= settings->beta) {
-                    shouldAttach = true;
+    const int margin = settings->boundaryMargin;
+
+    // The crystal only grows, so its extent says whether any crystal site is
+    // within the margin. The hexagon also has slanted edges, R hex steps out.
+    const int radius = N - 1 - N / 2;
+    return crystalExtent.minRow < margin || crystalExtent.maxRow >= N - margin ||
+           crystalExtent.minCol < margin || crystalExtent.maxCol >= N - margin ||
+           (hexagonal && crystalReach > radius - margin);
+}
+
+template <typename Layout>
+void BasicModel<Layout>::time_step() {
+    #ifdef GG_TRACE
+    const double traceStart = traceMicros();
+    const PhaseTimes timesBefore = phaseTimes;
+    #endif
+
+    // Skip simulation if crystal has reached the boundary
+    {
+        GG_TIME_PHASE(phaseTimes, Phase::BOUNDARY_CHECK);
+        if (hasReachedBoundary()) {
+            return;
+        }
+    }
+
+    const StepParameters parameters = {
+        settings->kappa, settings->mu, settings->gamma,
+        settings->beta, settings->theta, settings->alpha,
+        settings->sigma
+    };
+    if (!stepFunction || !(parameters == stepParameters)) {
+        stepParameters = parameters;
+        stepFunction = selectStep(parameters);
+    }
+    #ifdef GG_TRACE
+    const size_t cellsVisited = activeCellCount();
+    #endif
+    (this->*stepFunction)(parameters);
+    #ifdef GG_TRACE
+    stepTrace.push(stepRecord(stepCount, traceStart, timesBefore, phaseTimes, cellsVisited, attached.size()));
+    #endif
+    stepCount++;
+}
+
+template <typename Layout>
+typename BasicModel<Layout>::StepFunction BasicModel<Layout>::selectStep(const StepParameters& parameters) {
+    // Without crystal melting gamma * crystalMass is zero. The knife-edge
+    // rule needs vapor below theta (masses are never negative) and boundary
+    // mass of at least alpha, but below 1, which attaches anyway.
+    const bool crystalMelting = parameters.gamma != 0.0f;
+    const bool knifeEdge = parameters.theta > 0.0f && parameters.alpha < 1.0f;
+    const bool noise = parameters.sigma != 0.0f;
+
+    static const StepFunction steps[8] = {
+        &BasicModel::step<StepRegime<false, false, false>>, &BasicModel::step<StepRegime<false, false, true>>,
+        &BasicModel::step<StepRegime<false, true, false>>, &BasicModel::step<StepRegime<false, true, true>>,
+        &BasicModel::step<StepRegime<true, false, false>>, &BasicModel::step<StepRegime<true, false, true>>,
+        &BasicModel::step<StepRegime<true, true, false>>, &BasicModel::step<StepRegime<true, true, true>>
+    };
+    return steps[crystalMelting * 4 + knifeEdge * 2 + noise];
+}
+
+template <typename Layout>
+template <typename Regime>
+void BasicModel<Layout>::step(const StepParameters& parameters) {
+    if (settings->fusedStep) {
+        { GG_TIME_PHASE(phaseTimes, Phase::DIFFUSION); fusedDiffusionFreezing(parameters); }
+        { GG_TIME_PHASE(phaseTimes, Phase::ATTACHMENT); attachment<Regime>(parameters); }
+        { GG_TIME_PHASE(phaseTimes, Phase::MELTING); frontierMelting<Regime>(parameters); }
+    } else {
+        { GG_TIME_PHASE(phaseTimes, Phase::DIFFUSION); diffusion(); }
+        { GG_TIME_PHASE(phaseTimes, Phase::FREEZING); freezing(parameters); }
+        { GG_TIME_PHASE(phaseTimes, Phase::ATTACHMENT); attachment<Regime>(parameters); }
+        { GG_TIME_PHASE(phaseTimes, Phase::MELTING); melting<Regime>(parameters); }
+    }
+
+    if constexpr (Regime::noise) {
+        GG_TIME_PHASE(phaseTimes, Phase::NOISE);
+        noise(parameters);
+    }
+}
+
+template <typename Layout>
+void BasicModel<Layout>::beginDiffusion() {
+    // Vapor can spread one cell beyond the active region per step. The cells
+    // read around that ring have to hold the far-field value.
+    fillFarField(lower_bound_row - 2, upper_bound_row + 2, lower_bound_col - 2, upper_bound_col + 2);
+    growActiveRegion(lower_bound_row - 1, upper_bound_row + 1, lower_bound_col - 1, upper_bound_col + 1);
+
+    if (symmetric) {
+        refreshGhosts();
+    }
+}
+
+template <typename Layout>
+void BasicModel<Layout>::endDiffusion() {
+    snowflake.swapDiffusion(lower_bound_row, upper_bound_row, lower_bound_col, upper_bound_col);
+
+    // Far-field cells see six far-field neighbors (or reflect their own value
+    // at the edges), so the same sum applies to all of them
+    const float farFieldPair = ambient + ambient;
+    ambient = Layout::vaporStep(kernelWeight * stencilSum(ambient, farFieldPair, farFieldPair, farFieldPair));
+    if constexpr (isTiledGrid<Layout>) {
+        // Missing tiles lie outside the active region
+        snowflake.farVapor = ambient;
+    }
+
+    shrinkActiveRegion();
+}
+
+template <typename Layout>
+inline float BasicModel<Layout>::diffusedMass(int i, int j) const {
+    // Sum contributions from center and 6 neighbors
+    const float own = snowflake.diffusiveMassAt(i, j);
+
+    auto contribution = [&](const Point& neighbor) {
+        int x = i + neighbor.first;
+        int y = j + neighbor.second;
+
+        // Boundary check - clamp instead of wrap (removed modulo)
+        if (!snowflake.domain.contains(x, y)) {
+            // Reflecting boundary: use current cell's value
+            return own;
+        } else if (snowflake.isCrystalAt(x, y)) {
+            // Reflecting boundary: use current cell's value instead of crystal neighbor
+            return own;
+        }
+        // Normal diffusion from non-crystal neighbor
+        return snowflake.diffusiveMassAt(x, y);
+    };
+
+    // Opposite neighbors are paired up
+    const float sum = stencilSum(own,
+        contribution(neighbors[0]) + contribution(neighbors[5]),
+        contribution(neighbors[1]) + contribution(neighbors[4]),
+        contribution(neighbors[2]) + contribution(neighbors[3]));
+    return kernelWeight * sum;
+}
+
+template <typename Layout>
+void BasicModel<Layout>::diffuseRow(int i) {
+    // The struct-of-arrays grid has the halo the vectorized kernels need
+    if constexpr (std::is_same_v<Layout, Grid>) {
+        if (settings->simdDiffusion) {
+            const StencilRows stencil = {
+                snowflake.diffusiveMass[i - 1], snowflake.diffusiveMass[i], snowflake.diffusiveMass[i + 1],
+                snowflake.isCrystal[i - 1], snowflake.isCrystal[i], snowflake.isCrystal[i + 1],
+                snowflake.nextDiffusiveMass[i]
+            };
+            diffuseRowKernel(stencil, colBegin(i), colEnd(i), kernelWeight);
+            return;
+        }
+    } else if constexpr (isCompactGrid<Layout>) {
+        // Widen the three rows to float, run the same kernel and round the
+        // result, which is what the scalar loop below does cell by cell
+        if (settings->simdDiffusion) {
+            const int begin = colBegin(i);
+            const int end = colEnd(i);
+            const int width = cols + 2;
+            thread_local std::vector<float> scratch;
+            scratch.resize(4 * width);
+            float* above = scratch.data() + 1;
+            float* row = above + width;
+            float* below = row + width;
+            float* out = below + width;
+            snowflake.decodeVapor(i - 1, begin - 1, end + 1, above);
+            snowflake.decodeVapor(i, begin - 1, end + 1, row);
+            snowflake.decodeVapor(i + 1, begin - 1, end + 1, below);
+
+            const StencilRows stencil = {
+                above, row, below,
+                snowflake.isCrystal[i - 1], snowflake.isCrystal[i], snowflake.isCrystal[i + 1],
+                out
+            };
+            diffuseRowKernel(stencil, begin, end, kernelWeight);
+            snowflake.encodeNextVapor(i, begin, end, out);
+            return;
+        }
+    } else if constexpr (isTiledGrid<Layout>) {
+        // Gather the three rows from their tiles, run the same kernel and
+        // scatter the result back
+        if (settings->simdDiffusion) {
+            const int begin = colBegin(i);
+            const int end = colEnd(i);
+            const int width = cols + 2;
+            thread_local std::vector<float> scratch;
+            thread_local std::vector<uint8_t> crystal;
+            scratch.resize(4 * width);
+            crystal.resize(3 * width);
+            float* above = scratch.data() + 1;
+            float* row = above + width;
+            float* below = row + width;
+            float* out = below + width;
+            uint8_t* crystalAbove = crystal.data() + 1;
+            uint8_t* crystalRow = crystalAbove + width;
+            uint8_t* crystalBelow = crystalRow + width;
+            snowflake.readRow(i - 1, begin - 1, end + 1, above, crystalAbove);
+            snowflake.readRow(i, begin - 1, end + 1, row, crystalRow);
+            snowflake.readRow(i + 1, begin - 1, end + 1, below, crystalBelow);
+
+            const StencilRows stencil = {
+                above, row, below,
+                crystalAbove, crystalRow, crystalBelow,
+                out
+            };
+            diffuseRowKernel(stencil, begin, end, kernelWeight);
+            snowflake.writeNextVapor(i, begin, end, out);
+            return;
+        }
+    }
+
+    const int end = colEnd(i);
+    for (int j = colBegin(i); j < end; ++j) {
+        // Crystal sites have no diffusive mass
+        if (snowflake.isCrystalAt(i, j)) {
+            snowflake.nextDiffusiveMassAt(i, j) = 0.0;
+            continue;
+        }
+
+        snowflake.nextDiffusiveMassAt(i, j) = diffusedMass(i, j);
+    }
+}
+
+template <typename Layout>
+template <typename Function>
+int BasicModel<Layout>::parallelFor(int begin, int end, int minPerBand, Function function) {
+    // Splits [begin, end) into contiguous bands, one per pool thread, and
+    // returns how many were used. Small ranges are not worth waking the
+    // workers for.
+    const int bands = pool ? std::min(pool->size(), (end - begin) / minPerBand) : 1;
+    if (bands <= 1) {
+        function(0, begin, end);
+        return 1;
+    }
+
+    auto band = [&](int index) {
+        if (index >= bands) return;
+        function(index, begin + (end - begin) * index / bands, begin + (end - begin) * (index + 1) / bands);
+    };
+    pool->run(band);
+    return bands;
+}
+
+template <typename Layout>
+void BasicModel<Layout>::diffusion() {
+    beginDiffusion();
+
+    // Rows only read the current buffer and write their own row of the next
+    // one, so row bands need no synchronization
+    parallelFor(lower_bound_row, upper_bound_row, MIN_ROWS_PER_BAND, [&](int, int rowBegin, int rowEnd) {
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            diffuseRow(i);
+        }
+    });
+
+    endDiffusion();
+}
+
+template <typename Layout>
+void BasicModel<Layout>::fusedDiffusionFreezing(const StepParameters& parameters) {
+    // Same as diffusion() followed by freezing(): freezing is pointwise, so a
+    // boundary site can convert its new diffusive mass as soon as it is known
+    const float kappa = parameters.kappa;
+
+    beginDiffusion();
+
+    parallelFor(lower_bound_row, upper_bound_row, MIN_ROWS_PER_BAND, [&](int, int rowBegin, int rowEnd) {
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            diffuseRow(i);
+
+            // Freeze the row while it is still in cache
+            const int end = colEnd(i);
+            for (int j = colBegin(i); j < end; ++j) {
+                if (snowflake.isBoundaryAt(i, j) && !snowflake.isCrystalAt(i, j)) {
+                    auto&& diffusiveMass = snowflake.nextDiffusiveMassAt(i, j);
+                    snowflake.crystalMassAt(i, j) += kappa * diffusiveMass;
+                    snowflake.boundaryMassAt(i, j) += (1.0f - kappa) * diffusiveMass;
+                    diffusiveMass = 0.0;
                 }
             }
-            // Case 3: Concavities (3 attached neighbors)
-            else if (attachedNeighbors == 3) {
-                // Always attach if boundary mass >= 1
-                if (snowflake.boundaryMass[i][j] >= 1.0f) {
-                    shouldAttach = true;
+        }
+    });
+
+    endDiffusion();
+}
+
+template <typename Layout>
+void BasicModel<Layout>::freezing(const StepParameters& parameters) {
+    const float kappa = parameters.kappa;
+
+    parallelFor(lower_bound_row, upper_bound_row, MIN_ROWS_PER_BAND, [&](int, int rowBegin, int rowEnd) {
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            const int end = colEnd(i);
+            for (int j = colBegin(i); j < end; ++j) {
+                // Ensure crystal sites have no diffusive mass
+                if (snowflake.isCrystalAt(i, j)) {
+                    snowflake.diffusiveMassAt(i, j) = 0.0;
+                    continue;
                 }
-                // Knife-edge instability: attach if low diffusive mass and boundary mass >= alpha
-                else {
-                    // Calculate neighborhood diffusive mass (center + 6 neighbors)
-                    float neighbourhoodDiffusiveMass = snowflake.diffusiveMass[i][j];
-                    
-                    for (auto& neighbor : neighbors) {
-                        int x = i + neighbor.first;
-                        int y = j + neighbor.second;
-                        
-                        // Boundary check (removed modulo)
-                        if (x >= 0 && x < N && y >= 0 && y < N && snowflake.isCrystal[x][y] == 0) {
-                            neighbourhoodDiffusiveMass += snowflake.diffusiveMass[x][y];
-                        }
-                    }
-                    
-                    // If vapor is depleted AND boundary mass exceeds alpha, attach
-                    if (neighbourhoodDiffusiveMass < settings->theta && 
-                        snowflake.boundaryMass[i][j] >= settings->alpha) {
-                        shouldAttach = true;
-                    }
+
+                // Only boundary sites participate in freezing
+                if (snowflake.isBoundaryAt(i, j)) {
+                    auto&& diffusiveMass = snowflake.diffusiveMassAt(i, j);
+
+                    // Proportion kappa crystallizes directly
+                    snowflake.crystalMassAt(i, j) += kappa * diffusiveMass;
+
+                    // Proportion (1-kappa) becomes boundary mass (quasi-liquid)
+                    snowflake.boundaryMassAt(i, j) += (1.0f - kappa) * diffusiveMass;
+
+                    // All diffusive mass at boundary is now converted
+                    diffusiveMass = 0.0;
                 }
             }
-            // Case 4+: Highly concave (4+ attached neighbors) - always attach
-            else { // attachedNeighbors >= 4
-                shouldAttach = true;
+        }
+    });
+}
+
+template <typename Layout>
+template <typename Regime>
+bool BasicModel<Layout>::attaches(int i, int j, const StepParameters& parameters) const {
+    // Count attached neighbors
+    int attachedNeighbors = 0;
+    for (auto& neighbor : neighbors) {
+        int x = i + neighbor.first;
+        int y = j + neighbor.second;
+
+        // Boundary check (removed modulo)
+        if (snowflake.domain.contains(x, y) && snowflake.isCrystalAt(x, y)) {
+            attachedNeighbors++;
+        }
+    }
+
+    // Skip if not a boundary site
+    if (attachedNeighbors == 0) return false;
+
+    const float boundaryMass = snowflake.boundaryMassAt(i, j);
+
+    // Case 1 & 2: Tips and flat spots (1 or 2 attached neighbors)
+    if (attachedNeighbors == 1 || attachedNeighbors == 2) {
+        return boundaryMass >= parameters.beta;
+    }
+    // Case 3: Concavities (3 attached neighbors)
+    else if (attachedNeighbors == 3) {
+        // Always attach if boundary mass >= 1
+        if (boundaryMass >= 1.0f) {
+            return true;
+        }
+
+        // Knife-edge instability: attach if low diffusive mass and boundary mass >= alpha
+        if constexpr (!Regime::knifeEdge) {
+            return false;
+        }
+
+        // Calculate neighborhood diffusive mass (center + 6 neighbors)
+        auto contribution = [&](const Point& neighbor) {
+            int x = i + neighbor.first;
+            int y = j + neighbor.second;
+
+            // Boundary check (removed modulo)
+            if (snowflake.domain.contains(x, y) && !snowflake.isCrystalAt(x, y)) {
+                return snowflake.diffusiveMassAt(x, y);
             }
-            
-            if (shouldAttach) {
-                // Mark as crystal
-                newIsCrystal[i][j] = 1;
-                
+            return 0.0f;
+        };
+
+        const float neighbourhoodDiffusiveMass = stencilSum(snowflake.diffusiveMassAt(i, j),
+            contribution(neighbors[0]) + contribution(neighbors[5]),
+            contribution(neighbors[1]) + contribution(neighbors[4]),
+            contribution(neighbors[2]) + contribution(neighbors[3]));
+
+        // If vapor is depleted AND boundary mass exceeds alpha, attach
+        return neighbourhoodDiffusiveMass < parameters.theta &&
+               boundaryMass >= parameters.alpha;
+    }
+
+    // Case 4+: Highly concave (4+ attached neighbors) - always attach
+    return true;
+}
+
+template <typename Layout>
+template <typename Regime>
+void BasicModel<Layout>::attachment(const StepParameters& parameters) {
+    if (symmetric) {
+        refreshGhosts();
+    }
+
+    // Attachment decisions must all see the crystal as it was at the start of
+    // the step, so newly attached sites are collected and applied afterwards.
+    // Only frontier sites can attach; the ones that don't carry over to the
+    // next frontier. Each band collects its own lists, which are joined in
+    // band order so the frontier order doesn't depend on the thread count.
+    const int bands = pool ? pool->size() : 1;
+    bandAttached.resize(bands);
+    bandFrontier.resize(bands);
+
+    const int usedBands = parallelFor(0, static_cast<int>(frontier.size()), MIN_SITES_PER_BAND, [&](int band, int begin, int end) {
+        bandAttached[band].clear();
+        bandFrontier[band].clear();
+
+        for (int k = begin; k < end; ++k) {
+            const Point site = frontier[k];
+
+            if (attaches<Regime>(site.first, site.second, parameters)) {
+                bandAttached[band].push_back(site);
+
                 // Transfer boundary mass to crystal mass (equation 3d)
-                snowflake.crystalMass[i][j] += snowflake.boundaryMass[i][j];
-                snowflake.boundaryMass[i][j] = 0.0;
-                
-                // Mark all non-crystal neighbors as boundary sites
-                for (auto& neighbor : neighbors) {
-                    int x = i + neighbor.first;
-                    int y = j + neighbor.second;
-                    
-                    // Boundary check (removed modulo)
-                    if (x >= 0 && x < N && y >= 0 && y < N && snowflake.isCrystal[x][y] == 0) {
-                        newIsBoundary[x][y] = 1;
-                    }
+                auto&& boundaryMass = snowflake.boundaryMassAt(site.first, site.second);
+                snowflake.crystalMassAt(site.first, site.second) += boundaryMass;
+                boundaryMass = 0.0;
+            } else {
+                bandFrontier[band].push_back(site);
+            }
+        }
+    });
+
+    attached.clear();
+    nextFrontier.clear();
+    for (int band = 0; band < usedBands; ++band) {
+        attached.insert(attached.end(), bandAttached[band].begin(), bandAttached[band].end());
+        nextFrontier.insert(nextFrontier.end(), bandFrontier[band].begin(), bandFrontier[band].end());
+    }
+
+    // Mark all non-crystal neighbors as boundary sites. This has to happen
+    // before the new crystal sites are set, since it checks the old crystal
+    for (auto& site : attached) {
+        growActiveRegion(site.first - 1, site.first + 2, site.second - 1, site.second + 2);
+
+        for (auto& neighbor : neighbors) {
+            int x = site.first + neighbor.first;
+            int y = site.second + neighbor.second;
+
+            // Boundary check (removed modulo)
+            if (!snowflake.domain.contains(x, y)) continue;
+
+            // A ghost stands for its image in the wedge
+            const Point marked = canonical(x, y);
+            if (!snowflake.isCrystalAt(marked.first, marked.second) && !snowflake.isBoundaryAt(marked.first, marked.second)) {
+                snowflake.setBoundary(marked.first, marked.second, true);
+                nextFrontier.push_back(marked);
+                if (symmetric) {
+                    growActiveRegion(marked.first - 1, marked.first + 2, marked.second - 1, marked.second + 2);
                 }
             }
         }
     }
-    
-    // Update grids
-    snowflake.isCrystal = newIsCrystal;
-    isBoundary = newIsBoundary;
+
+    // Mark as crystal
+    for (auto& site : attached) {
+        snowflake.setCrystal(site.first, site.second, true);
+
+        const int a = site.first - center.first;
+        const int b = site.second - center.second;
+        crystalReach = std::max({crystalReach, std::abs(a), std::abs(b), std::abs(a - b)});
+
+        if (symmetric) {
+            // Its images put crystal as far from the seed in every direction
+            const int mid = settings->gridSize / 2;
+            crystalExtent.minRow = crystalExtent.minCol = mid - crystalReach;
+            crystalExtent.maxRow = crystalExtent.maxCol = mid + crystalReach;
+            continue;
+        }
+
+        crystalExtent.minRow = std::min(crystalExtent.minRow, site.first);
+        crystalExtent.maxRow = std::max(crystalExtent.maxRow, site.first);
+        crystalExtent.minCol = std::min(crystalExtent.minCol, site.second);
+        crystalExtent.maxCol = std::max(crystalExtent.maxCol, site.second);
+    }
+
+    std::swap(frontier, nextFrontier);
 }
 
-void Model::melting() {
-    for (int i = lower_bound_row; i < upper_bound_row; ++i) {
-        for (int j = lower_bound_col; j < upper_bound_col; ++j) {
-            // Only boundary sites participate in melting
-            if (isBoundary[i][j] && snowflake.isCrystal[i][j] == 0) {
-                // Calculate melted amounts
-                float meltedBoundary = settings->mu * snowflake.boundaryMass[i][j];
-                float meltedCrystal = settings->gamma * snowflake.crystalMass[i][j];
-                
-                // Reduce boundary and crystal mass
-                snowflake.boundaryMass[i][j] -= meltedBoundary;
-                snowflake.crystalMass[i][j] -= meltedCrystal;
-                
-                // Add melted mass back to diffusive mass
-                snowflake.diffusiveMass[i][j] += meltedBoundary + meltedCrystal;
+template <typename Layout>
+template <typename Regime>
+void BasicModel<Layout>::melting(const StepParameters& parameters) {
+    const float mu = parameters.mu;
+    const float gamma = parameters.gamma;
+
+    parallelFor(lower_bound_row, upper_bound_row, MIN_ROWS_PER_BAND, [&](int, int rowBegin, int rowEnd) {
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            const int end = colEnd(i);
+            for (int j = colBegin(i); j < end; ++j) {
+                // Only boundary sites participate in melting
+                if (snowflake.isBoundaryAt(i, j) && !snowflake.isCrystalAt(i, j)) {
+                    meltSite<Regime>(i, j, mu, gamma);
+                }
             }
         }
+    });
+}
+
+template <typename Layout>
+template <typename Regime>
+void BasicModel<Layout>::frontierMelting(const StepParameters& parameters) {
+    // After attachment the frontier holds exactly the boundary sites that are
+    // not crystal, i.e. the sites melting() would pick out of the full sweep
+    const float mu = parameters.mu;
+    const float gamma = parameters.gamma;
+
+    parallelFor(0, static_cast<int>(frontier.size()), MIN_SITES_PER_BAND, [&](int, int begin, int end) {
+        for (int k = begin; k < end; ++k) {
+            meltSite<Regime>(frontier[k].first, frontier[k].second, mu, gamma);
+        }
+    });
+}
+
+template <typename Layout>
+template <typename Regime>
+inline void BasicModel<Layout>::meltSite(int i, int j, float mu, float gamma) {
+    // Calculate melted amounts
+    const float meltedBoundary = mu * snowflake.boundaryMassAt(i, j);
+    snowflake.boundaryMassAt(i, j) -= meltedBoundary;
+
+    // Without crystal melting, gamma * crystalMass adds nothing
+    if constexpr (Regime::crystalMelting) {
+        const float meltedCrystal = gamma * snowflake.crystalMassAt(i, j);
+        snowflake.crystalMassAt(i, j) -= meltedCrystal;
+        snowflake.diffusiveMassAt(i, j) += meltedBoundary + meltedCrystal;
+    } else {
+        snowflake.diffusiveMassAt(i, j) += meltedBoundary;
     }
 }
 
-#endif // GG_MODEL_H
\ No newline at end of file
+template <typename Layout>
+void BasicModel<Layout>::noise(const StepParameters& parameters) {
+    // The far field isn't uniform any more once it has been perturbed, so
+    // the whole grid stays active. Regrowing every step also takes back any
+    // row that happened to settle on the far-field value.
+    growActiveRegion(0, rows, 0, cols);
+
+    // Indexed rather than branched on, the bits are random after all
+    const float factors[2] = {1.0f - parameters.sigma, 1.0f + parameters.sigma};
+    const uint32_t seed = settings->seed;
+
+    // Noise is keyed on full grid coordinates, which in symmetric mode are
+    // those of the wedge cell itself (the image at the seed's offset)
+    const int mid = settings->gridSize / 2;
+    const int colOffset = mid - center.second;
+
+    parallelFor(lower_bound_row, upper_bound_row, MIN_ROWS_PER_BAND, [&](int, int rowBegin, int rowEnd) {
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            NoiseBits bits(seed, stepCount, i - center.first + mid);
+            const int end = colEnd(i);
+            for (int j = colBegin(i); j < end; ++j) {
+                snowflake.diffusiveMassAt(i, j) *= factors[bits(j + colOffset)];
+            }
+        }
+    });
+}
+
+#endif // GG_MODEL_H
@@ -0,0 +1,444 @@
+#ifndef GG_GRID_H
+#define GG_GRID_H
+
+#include "field.h"
+#include "precision.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using FloatGrid = Field<float>;
+using ByteGrid = Field<uint8_t>;
+using Point = std::pair<int, int>;
+
+// The cells a grid stores, as one column range per row. Anything outside
+// counts as off the grid.
+struct Domain {
+    std::vector<RowExtent> extents;
+
+    int rows() const { return static_cast<int>(extents.size()); }
+    const RowExtent& operator[](int i) const { return extents[i]; }
+    bool contains(int i, int j) const {
+        return i >= 0 && i < rows() && j >= extents[i].begin && j < extents[i].end;
+    }
+
+    // The whole N x N square
+    static Domain square(int N) {
+        return {std::vector<RowExtent>(N, RowExtent{0, N})};
+    }
+
+    // The hexagon of cells within R = N - 1 - N/2 hex steps of (N/2, N/2),
+    // the largest one inside the square. With the neighbor offsets used here,
+    // (a, b) away from the center is max(|a|, |b|, |a - b|) steps.
+    static Domain hexagon(int N) {
+        const int center = N / 2;
+        const int radius = N - 1 - center;
+        Domain domain = {std::vector<RowExtent>(N, RowExtent{0, 0})};
+        for (int a = -radius; a <= radius; ++a) {
+            domain.extents[center + a] = {center + std::max(-radius, a - radius),
+                                          center + std::min(radius, a + radius) + 1};
+        }
+        return domain;
+    }
+};
+
+// Cell layouts. The model only talks to its grid through the accessors below,
+// so any layout can be plugged into BasicModel:
+//   Grid        - struct of arrays, one field per quantity
+//   PackedGrid  - array of structs, all per-cell state in one 16 byte Cell
+//   CompactGrid - struct of arrays with 16-bit vapor and crystal mass
+//   TiledGrid   - 64 x 64 tiles, allocated once they differ from the far field
+//
+// vaporStep(mass) is the diffusive mass as stored, which the model needs to
+// keep the far-field value exactly representable.
+
+// Struct-of-arrays layout. The crystal and diffusive mass fields carry a
+// one cell halo (marked as crystal) for the vectorized diffusion kernels.
+struct Grid {
+    Domain domain;
+    ByteGrid isCrystal;
+    ByteGrid isBoundary;
+    FloatGrid boundaryMass;
+    FloatGrid crystalMass;
+    FloatGrid diffusiveMass;
+    FloatGrid nextDiffusiveMass;    // Diffusion write buffer
+
+    void initialize(const Domain& shape, float rho) {
+        domain = shape;
+        isCrystal = ByteGrid(domain.extents, 0, 1, 1);
+        isBoundary = ByteGrid(domain.extents, 0);
+        boundaryMass = FloatGrid(domain.extents, 0.0f);
+        crystalMass = FloatGrid(domain.extents, 0.0f);
+        diffusiveMass = FloatGrid(domain.extents, rho, 1);
+        nextDiffusiveMass = FloatGrid(domain.extents, 0.0f, 1);
+    }
+
+    bool isCrystalAt(int i, int j) const { return isCrystal[i][j]; }
+    bool isBoundaryAt(int i, int j) const { return isBoundary[i][j]; }
+    void setCrystal(int i, int j, bool value) { isCrystal[i][j] = value; }
+    void setBoundary(int i, int j, bool value) { isBoundary[i][j] = value; }
+
+    float& boundaryMassAt(int i, int j) { return boundaryMass[i][j]; }
+    float& crystalMassAt(int i, int j) { return crystalMass[i][j]; }
+    float& diffusiveMassAt(int i, int j) { return diffusiveMass[i][j]; }
+    float& nextDiffusiveMassAt(int i, int j) { return nextDiffusiveMass[i][j]; }
+    float boundaryMassAt(int i, int j) const { return boundaryMass[i][j]; }
+    float crystalMassAt(int i, int j) const { return crystalMass[i][j]; }
+    float diffusiveMassAt(int i, int j) const { return diffusiveMass[i][j]; }
+    static float vaporStep(float mass) { return mass; }
+
+    // Publish the diffusion write buffer (rows/cols bound the region written)
+    void swapDiffusion(int, int, int, int) { std::swap(diffusiveMass, nextDiffusiveMass); }
+};
+
+constexpr uint8_t CRYSTAL_FLAG = 1 << 0;
+constexpr uint8_t BOUNDARY_FLAG = 1 << 1;
+
+inline void setFlag(uint8_t& flags, uint8_t flag, bool value) {
+    flags = value ? (flags | flag) : (flags & ~flag);
+}
+
+struct Cell {
+    float boundaryMass;
+    float crystalMass;
+    float diffusiveMass;
+    uint8_t flags;      // CRYSTAL_FLAG | BOUNDARY_FLAG
+};
+
+// Array-of-structs layout
+struct PackedGrid {
+    Domain domain;
+    Field<Cell> cells;
+    FloatGrid nextDiffusiveMass;    // Diffusion write buffer
+
+    void initialize(const Domain& shape, float rho) {
+        domain = shape;
+        cells = Field<Cell>(domain.extents, Cell{0.0f, 0.0f, rho, 0});
+        nextDiffusiveMass = FloatGrid(domain.extents, 0.0f);
+    }
+
+    bool isCrystalAt(int i, int j) const { return cells[i][j].flags & CRYSTAL_FLAG; }
+    bool isBoundaryAt(int i, int j) const { return cells[i][j].flags & BOUNDARY_FLAG; }
+    void setCrystal(int i, int j, bool value) { setFlag(cells[i][j].flags, CRYSTAL_FLAG, value); }
+    void setBoundary(int i, int j, bool value) { setFlag(cells[i][j].flags, BOUNDARY_FLAG, value); }
+
+    float& boundaryMassAt(int i, int j) { return cells[i][j].boundaryMass; }
+    float& crystalMassAt(int i, int j) { return cells[i][j].crystalMass; }
+    float& diffusiveMassAt(int i, int j) { return cells[i][j].diffusiveMass; }
+    float& nextDiffusiveMassAt(int i, int j) { return nextDiffusiveMass[i][j]; }
+    float boundaryMassAt(int i, int j) const { return cells[i][j].boundaryMass; }
+    float crystalMassAt(int i, int j) const { return cells[i][j].crystalMass; }
+    float diffusiveMassAt(int i, int j) const { return cells[i][j].diffusiveMass; }
+    static float vaporStep(float mass) { return mass; }
+
+    // Diffusive mass lives inside the cells, so copy the write buffer back
+    void swapDiffusion(int rowBegin, int rowEnd, int colBegin, int colEnd) {
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            Cell* row = cells[i];
+            const float* next = nextDiffusiveMass[i];
+            const int end = std::min(colEnd, domain[i].end);
+            for (int j = std::max(colBegin, domain[i].begin); j < end; ++j) {
+                row[j].diffusiveMass = next[j];
+            }
+        }
+    }
+};
+
+// Struct-of-arrays layout with the vapor and crystal mass stored in 16 bits
+// (Precision is HalfPrecision or FixedPrecision from precision.h), the same
+// halos as Grid, and accessors that round on every store. Boundary mass stays
+// float: it collects a little vapor every step until it reaches beta or
+// alpha, and increments smaller than half a 16-bit step would be lost,
+// stalling sites just below the threshold.
+template <typename Precision>
+struct CompactGrid {
+    using Vapor = typename Precision::Vapor;
+    using Solid = typename Precision::Solid;
+
+    Domain domain;
+    ByteGrid isCrystal;
+    ByteGrid isBoundary;
+    FloatGrid boundaryMass;
+    Field<typename Solid::Storage> crystalMass;
+    Field<typename Vapor::Storage> diffusiveMass;
+    Field<typename Vapor::Storage> nextDiffusiveMass;   // Diffusion write buffer
+
+    void initialize(const Domain& shape, float rho) {
+        domain = shape;
+        isCrystal = ByteGrid(domain.extents, 0, 1, 1);
+        isBoundary = ByteGrid(domain.extents, 0);
+        boundaryMass = FloatGrid(domain.extents, 0.0f);
+        crystalMass = Field<typename Solid::Storage>(domain.extents, Solid::encode(0.0f));
+        diffusiveMass = Field<typename Vapor::Storage>(domain.extents, Vapor::encode(rho), 1);
+        nextDiffusiveMass = Field<typename Vapor::Storage>(domain.extents, Vapor::encode(0.0f), 1);
+    }
+
+    bool isCrystalAt(int i, int j) const { return isCrystal[i][j]; }
+    bool isBoundaryAt(int i, int j) const { return isBoundary[i][j]; }
+    void setCrystal(int i, int j, bool value) { isCrystal[i][j] = value; }
+    void setBoundary(int i, int j, bool value) { isBoundary[i][j] = value; }
+
+    float& boundaryMassAt(int i, int j) { return boundaryMass[i][j]; }
+    MassRef<Solid> crystalMassAt(int i, int j) { return MassRef<Solid>(crystalMass[i][j]); }
+    MassRef<Vapor> diffusiveMassAt(int i, int j) { return MassRef<Vapor>(diffusiveMass[i][j]); }
+    MassRef<Vapor> nextDiffusiveMassAt(int i, int j) { return MassRef<Vapor>(nextDiffusiveMass[i][j]); }
+    float boundaryMassAt(int i, int j) const { return boundaryMass[i][j]; }
+    float crystalMassAt(int i, int j) const { return Solid::decode(crystalMass[i][j]); }
+    float diffusiveMassAt(int i, int j) const { return Vapor::decode(diffusiveMass[i][j]); }
+    static float vaporStep(float mass) { return Vapor::decode(Vapor::encode(mass)); }
+
+    // Row i of the diffusive mass, columns [begin, end), as floats
+    void decodeVapor(int i, int begin, int end, float* out) const {
+        const typename Vapor::Storage* row = diffusiveMass[i];
+        for (int j = begin; j < end; ++j) {
+            out[j] = Vapor::decode(row[j]);
+        }
+    }
+
+    // Stores columns [begin, end) of row i of the diffusion write buffer
+    void encodeNextVapor(int i, int begin, int end, const float* in) {
+        typename Vapor::Storage* row = nextDiffusiveMass[i];
+        for (int j = begin; j < end; ++j) {
+            row[j] = Vapor::encode(in[j]);
+        }
+    }
+
+    void swapDiffusion(int, int, int, int) { std::swap(diffusiveMass, nextDiffusiveMass); }
+};
+
+template <typename Layout>
+constexpr bool isCompactGrid = false;
+template <typename Precision>
+constexpr bool isCompactGrid<CompactGrid<Precision>> = true;
+
+// Sparse layout for grids far larger than the crystal. The bounding box of
+// the domain is cut into 64 x 64 tiles, and a tile is only allocated once a
+// cell in it has to differ from the far field: until then every cell of it
+// reads as vapor farVapor and nothing else. The mutable accessors return a
+// CellRef, which leaves a missing tile alone when the value stored is the
+// one it already reads as, so filling in the far field allocates nothing.
+//
+// Tiles are never freed. cover() allocates a box of them up front, which
+// the model does for its active region before every sweep, so the sweeps
+// (which may run on several threads) only ever store into resident tiles.
+struct TiledGrid {
+    static constexpr int TILE_SHIFT = 6;
+    static constexpr int TILE_SIZE = 1 << TILE_SHIFT;
+    static constexpr int TILE_CELLS = TILE_SIZE * TILE_SIZE;
+
+    struct alignas(CACHE_LINE_SIZE) Tile {
+        float vapor[2][TILE_CELLS];     // Diffusive mass and write buffer, picked by parity
+        float boundaryMass[TILE_CELLS];
+        float crystalMass[TILE_CELLS];
+        uint8_t isCrystal[TILE_CELLS];
+        uint8_t isBoundary[TILE_CELLS];
+    };
+
+    enum Quantity { BOUNDARY_MASS, CRYSTAL_MASS, VAPOR, NEXT_VAPOR };
+
+    // Reference to one mass of one cell, see above
+    class CellRef {
+        public:
+            CellRef(TiledGrid& grid, int i, int j, Quantity quantity) : grid(grid), i(i), j(j), quantity(quantity) {}
+            operator float() const { return grid.read(i, j, quantity); }
+            CellRef& operator=(float mass) { grid.write(i, j, quantity, mass); return *this; }
+            CellRef& operator=(const CellRef& other) { return *this = static_cast<float>(other); }
+            CellRef& operator+=(float mass) { return *this = static_cast<float>(*this) + mass; }
+            CellRef& operator-=(float mass) { return *this = static_cast<float>(*this) - mass; }
+            CellRef& operator*=(float factor) { return *this = static_cast<float>(*this) * factor; }
+        private:
+            TiledGrid& grid;
+            int i, j;
+            Quantity quantity;
+    };
+
+    Domain domain;
+    float farVapor = 0.0f;  // Vapor of every cell of a missing tile
+
+    void initialize(const Domain& shape, float rho) {
+        domain = shape;
+        int cols = 0;
+        for (auto& extent : domain.extents) {
+            cols = std::max(cols, extent.end);
+        }
+        tileRows = (domain.rows() + TILE_SIZE - 1) >> TILE_SHIFT;
+        tileCols = (cols + TILE_SIZE - 1) >> TILE_SHIFT;
+        tiles.clear();
+        tiles.resize(static_cast<size_t>(tileRows) * tileCols);
+        spare.clear();
+        resident = 0;
+        covered = {0, 0, 0, 0};
+        parity = 0;
+        farVapor = rho;
+    }
+
+    bool isCrystalAt(int i, int j) const {
+        const Tile* tile = tileAt(i, j);
+        return tile && tile->isCrystal[cellIndex(i, j)];
+    }
+    bool isBoundaryAt(int i, int j) const {
+        const Tile* tile = tileAt(i, j);
+        return tile && tile->isBoundary[cellIndex(i, j)];
+    }
+    void setCrystal(int i, int j, bool value) {
+        if (Tile* tile = value ? materialize(i, j) : tileAt(i, j)) tile->isCrystal[cellIndex(i, j)] = value;
+    }
+    void setBoundary(int i, int j, bool value) {
+        if (Tile* tile = value ? materialize(i, j) : tileAt(i, j)) tile->isBoundary[cellIndex(i, j)] = value;
+    }
+
+    CellRef boundaryMassAt(int i, int j) { return CellRef(*this, i, j, BOUNDARY_MASS); }
+    CellRef crystalMassAt(int i, int j) { return CellRef(*this, i, j, CRYSTAL_MASS); }
+    CellRef diffusiveMassAt(int i, int j) { return CellRef(*this, i, j, VAPOR); }
+    CellRef nextDiffusiveMassAt(int i, int j) { return CellRef(*this, i, j, NEXT_VAPOR); }
+    float boundaryMassAt(int i, int j) const { return read(i, j, BOUNDARY_MASS); }
+    float crystalMassAt(int i, int j) const { return read(i, j, CRYSTAL_MASS); }
+    float diffusiveMassAt(int i, int j) const { return read(i, j, VAPOR); }
+    static float vaporStep(float mass) { return mass; }
+
+    // Columns [begin, end) of row i of the vapor and of the crystal flags,
+    // the way Grid's halo has them: cells off the domain are zero vapor and
+    // crystal
+    void readRow(int i, int begin, int end, float* vapor, uint8_t* crystal) const {
+        if (begin >= end) return;
+        const bool inside = i >= 0 && i < domain.rows();
+        const int first = inside ? std::clamp(domain[i].begin, begin, end) : end;
+        const int last = inside ? std::clamp(domain[i].end, first, end) : end;
+        std::fill(vapor + begin, vapor + first, 0.0f);
+        std::fill(crystal + begin, crystal + first, uint8_t(1));
+        std::fill(vapor + last, vapor + end, 0.0f);
+        std::fill(crystal + last, crystal + end, uint8_t(1));
+
+        for (int j = first; j < last;) {
+            const int spanEnd = std::min(last, (j | (TILE_SIZE - 1)) + 1);
+            if (const Tile* tile = tileAt(i, j)) {
+                const int k = cellIndex(i, j);
+                std::copy(tile->vapor[parity] + k, tile->vapor[parity] + k + (spanEnd - j), vapor + j);
+                std::copy(tile->isCrystal + k, tile->isCrystal + k + (spanEnd - j), crystal + j);
+            } else {
+                std::fill(vapor + j, vapor + spanEnd, farVapor);
+                std::fill(crystal + j, crystal + spanEnd, uint8_t(0));
+            }
+            j = spanEnd;
+        }
+    }
+
+    // Stores columns [begin, end) of row i of the diffusion write buffer,
+    // which have to lie in resident tiles
+    void writeNextVapor(int i, int begin, int end, const float* in) {
+        for (int j = begin; j < end;) {
+            const int spanEnd = std::min(end, (j | (TILE_SIZE - 1)) + 1);
+            std::copy(in + j, in + spanEnd, tileAt(i, j)->vapor[parity ^ 1] + cellIndex(i, j));
+            j = spanEnd;
+        }
+    }
+
+    // Allocates every tile of rows [rowBegin, rowEnd) and columns
+    // [colBegin, colEnd). The box covered so far grows to take it in, so
+    // covering a box inside it again costs nothing.
+    void cover(int rowBegin, int rowEnd, int colBegin, int colEnd) {
+        if (rowBegin >= rowEnd || colBegin >= colEnd) return;
+        const TileBox box = {std::max(rowBegin, 0) >> TILE_SHIFT, std::min(((rowEnd - 1) >> TILE_SHIFT) + 1, tileRows),
+                             std::max(colBegin, 0) >> TILE_SHIFT, std::min(((colEnd - 1) >> TILE_SHIFT) + 1, tileCols)};
+        if (box.rowBegin >= box.rowEnd || box.colBegin >= box.colEnd) return;
+        const bool inside = box.rowBegin >= covered.rowBegin && box.rowEnd <= covered.rowEnd &&
+                            box.colBegin >= covered.colBegin && box.colEnd <= covered.colEnd;
+        if (inside) return;
+
+        if (covered.rowBegin < covered.rowEnd) {
+            covered = {std::min(covered.rowBegin, box.rowBegin), std::max(covered.rowEnd, box.rowEnd),
+                       std::min(covered.colBegin, box.colBegin), std::max(covered.colEnd, box.colEnd)};
+        } else {
+            covered = box;
+        }
+        for (int a = covered.rowBegin; a < covered.rowEnd; ++a) {
+            for (int b = covered.colBegin; b < covered.colEnd; ++b) {
+                materialize(a << TILE_SHIFT, b << TILE_SHIFT);
+            }
+        }
+    }
+
+    // Drops every tile, so that every cell reads as vapor and nothing else.
+    // The tiles are kept for reuse.
+    void clear(float vapor) {
+        for (auto& tile : tiles) {
+            if (tile) spare.push_back(std::move(tile));
+        }
+        resident = 0;
+        covered = {0, 0, 0, 0};
+        farVapor = vapor;
+    }
+
+    size_t residentTiles() const { return resident; }
+
+    // Publishing the write buffer only flips which half of the tiles is current
+    void swapDiffusion(int, int, int, int) { parity ^= 1; }
+
+    private:
+        struct TileBox {
+            int rowBegin, rowEnd, colBegin, colEnd;
+        };
+
+        int tileRows = 0, tileCols = 0;
+        std::vector<std::unique_ptr<Tile>> tiles;   // Row-major, null while missing
+        std::vector<std::unique_ptr<Tile>> spare;   // Freed by clear()
+        size_t resident = 0;
+        TileBox covered = {0, 0, 0, 0};
+        int parity = 0;
+
+        static int cellIndex(int i, int j) {
+            return ((i & (TILE_SIZE - 1)) << TILE_SHIFT) | (j & (TILE_SIZE - 1));
+        }
+        Tile* tileAt(int i, int j) const {
+            return tiles[static_cast<size_t>(i >> TILE_SHIFT) * tileCols + (j >> TILE_SHIFT)].get();
+        }
+
+        Tile* materialize(int i, int j) {
+            auto& tile = tiles[static_cast<size_t>(i >> TILE_SHIFT) * tileCols + (j >> TILE_SHIFT)];
+            if (tile) return tile.get();
+            if (spare.empty()) {
+                tile = std::make_unique<Tile>();
+            } else {
+                tile = std::move(spare.back());
+                spare.pop_back();
+            }
+            std::fill(tile->vapor[0], tile->vapor[0] + TILE_CELLS, farVapor);
+            std::fill(tile->vapor[1], tile->vapor[1] + TILE_CELLS, farVapor);
+            std::fill(tile->boundaryMass, tile->boundaryMass + TILE_CELLS, 0.0f);
+            std::fill(tile->crystalMass, tile->crystalMass + TILE_CELLS, 0.0f);
+            std::fill(tile->isCrystal, tile->isCrystal + TILE_CELLS, uint8_t(0));
+            std::fill(tile->isBoundary, tile->isBoundary + TILE_CELLS, uint8_t(0));
+            ++resident;
+            return tile.get();
+        }
+
+        float* slot(Tile& tile, int k, Quantity quantity) const {
+            switch (quantity) {
+                case BOUNDARY_MASS: return &tile.boundaryMass[k];
+                case CRYSTAL_MASS: return &tile.crystalMass[k];
+                case VAPOR: return &tile.vapor[parity][k];
+                default: return &tile.vapor[parity ^ 1][k];
+            }
+        }
+        float read(int i, int j, Quantity quantity) const {
+            if (Tile* tile = tileAt(i, j)) return *slot(*tile, cellIndex(i, j), quantity);
+            return quantity == VAPOR || quantity == NEXT_VAPOR ? farVapor : 0.0f;
+        }
+        void write(int i, int j, Quantity quantity, float mass) {
+            Tile* tile = tileAt(i, j);
+            if (!tile) {
+                if (mass == read(i, j, quantity)) return;
+                tile = materialize(i, j);
+            }
+            *slot(*tile, cellIndex(i, j), quantity) = mass;
+        }
+};
+
+template <typename Layout>
+constexpr bool isTiledGrid = false;
+template <>
+constexpr bool isTiledGrid<TiledGrid> = true;
+
+#endif // GG_GRID_H
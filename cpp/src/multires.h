@@ -0,0 +1,396 @@
+#ifndef GG_MULTIRES_H
+#define GG_MULTIRES_H
+
+#include "gg_model.h"
+#include <cmath>
+#include <memory>
+
+// Two-level model for domains too large to hold at full resolution. A fine
+// patch, an ordinary model of its own, covers the crystal and the vapor
+// around it. A coarse grid with one cell per factor x factor block of the
+// gridSize x gridSize square carries the far-field vapor as the blocks' mean,
+// stored relative to the patch's far-field value (its ambient): blocks the
+// crystal hasn't disturbed stay exactly zero, and so the part of the patch
+// next to them stays outside its active region.
+//
+// The patch interior covers whole blocks, and its outermost ring of cells
+// (the frame) lies in the blocks around them. Before every step the frame
+// gets vapor interpolated from the coarse grid, so the interior sees the far
+// field along its edge. The vapor that flows from the frame into the interior
+// is taken out of the blocks holding the frame again (refluxing), which
+// keeps the total mass constant. Every factor^2 steps, the time vapor takes
+// to diffuse across a block, the coarse grid takes one step of the same
+// stencil. Blocks under the patch then take the mean of its cells
+// (restriction); they count as walls for that step, since the frame
+// already carries the vapor across the edge of the patch.
+//
+// Once the crystal comes within a quarter of the patch size of the frame,
+// the patch doubles around the seed, and the blocks it newly covers spread
+// their vapor evenly over their cells (prolongation). A patch that would
+// reach the edge of the domain becomes the whole grid, and from then on the
+// model runs like a plain one.
+//
+// The patch is a square grid without symmetry (useSymmetry, hexDomain and
+// vaporHalo are ignored), and noise only perturbs the patch. gridSize is
+// rounded up to a multiple of 2 * factor, which lines the blocks up around
+// the seed.
+template <typename Patch>
+class MultiresModel {
+    public:
+        // factor is the block size, patchSize roughly the first patch's
+        MultiresModel(ModelSettings&, int factor = 8, int patchSize = 256);
+        void initialize();
+        void time_step();
+        bool hasReachedBoundary() const;
+        Extent getCrystalExtent() const;    // In full grid coordinates
+        const ModelSettings& getSettings() const { return *settings; }
+        int gridSize() const { return size; }
+        // The fine patch, whose cell (0, 0) is cell (offset, offset) of the
+        // full grid. It is replaced whenever it grows.
+        Patch& patch() { return *fine; }
+        const Patch& patch() const { return *fine; }
+        int patchOffset() const { return offset; }
+        bool isCoupled() const { return coupled; }
+        // Vapor of cell (i, j) of the full grid, from the patch if it covers
+        // the cell and else the mean of its block
+        float vaporAt(int i, int j) const;
+        // Vapor, boundary and crystal mass over the whole domain
+        double totalMass() const;
+    private:
+        ModelSettings* settings;
+        const int factor;
+        const int firstPatchSize;
+        int size;       // gridSize, rounded up
+        int blocks;     // The coarse grid is blocks x blocks
+
+        std::unique_ptr<ModelSettings> patchSettings;
+        std::unique_ptr<Patch> fine;
+        bool coupled;           // Whether the patch is smaller than the grid
+        int patchBlocks;        // The interior covers blocks [firstBlock, firstBlock + patchBlocks)
+        int firstBlock;         // in both directions
+        int offset;
+
+        FloatGrid coarse, nextCoarse;   // Mean vapor of every block, less ambient
+        int lowBlock, highBlock;        // Blocks outside [lowBlock, highBlock) both ways are zero
+        Field<double> inflow;   // Vapor the frame in each block gave the interior since the last reflux
+        std::vector<std::pair<Point, float>> frame;    // Frame cells and their vapor, less ambient
+        int sinceCoarseStep;
+
+        const Point neighbors[6] = {
+            {-1, -1}, {-1, 0},
+            {0, -1}, {0, 1},
+            {1, 0}, {1, 1}
+        };
+
+        bool isCovered(int I, int J) const {
+            return coupled && I >= firstBlock && I < firstBlock + patchBlocks &&
+                   J >= firstBlock && J < firstBlock + patchBlocks;
+        }
+        void syncSettings();
+        void buildPatch(int wantedBlocks);
+        void imposeFrame();
+        void reflux();
+        void coarseStep();
+        void restrictPatch();
+        void interpolateFrame();
+        float interpolated(int i, int j) const;
+        float ambient() const { return fine->progress().ambient; }
+};
+
+template <typename Patch>
+MultiresModel<Patch>::MultiresModel(ModelSettings& settings, int factor, int patchSize)
+    : settings(&settings), factor(std::max(factor, 1)), firstPatchSize(patchSize) {
+    initialize();
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::initialize() {
+    size = (settings->gridSize + 2 * factor - 1) / (2 * factor) * (2 * factor);
+    blocks = size / factor;
+    coarse = FloatGrid(blocks, blocks, 0.0f);
+    nextCoarse = FloatGrid(blocks, blocks, 0.0f);
+    inflow = Field<double>(blocks, blocks, 0.0);
+    lowBlock = blocks / 2;
+    highBlock = blocks / 2;
+    sinceCoarseStep = 0;
+
+    fine.reset();
+    offset = 0;
+    const int wanted = std::max((firstPatchSize - 2) / factor, 2);
+    buildPatch(wanted + wanted % 2);
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::syncSettings() {
+    // The parameters follow settings, the geometry is the patch's own
+    *patchSettings = *settings;
+    patchSettings->gridSize = coupled ? patchBlocks * factor + 2 : size;
+    patchSettings->useSymmetry = false;
+    patchSettings->hexDomain = false;
+    patchSettings->vaporHalo = 0;
+    if (coupled) {
+        patchSettings->boundaryMargin = std::max(settings->boundaryMargin, patchSettings->gridSize / 4);
+    }
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::buildPatch(int wantedBlocks) {
+    // The frame has to stay inside the grid, so a patch that comes within a
+    // block of its edge takes the whole grid
+    const std::unique_ptr<ModelSettings> oldSettings = std::move(patchSettings);
+    const std::unique_ptr<Patch> old = std::move(fine);
+    const int oldOffset = offset;
+    coupled = wantedBlocks <= blocks - 2;
+    patchBlocks = coupled ? wantedBlocks : blocks;
+    firstBlock = (blocks - patchBlocks) / 2;
+    offset = coupled ? firstBlock * factor - 1 : 0;
+
+    patchSettings = std::make_unique<ModelSettings>();
+    syncSettings();
+    fine = std::make_unique<Patch>(*patchSettings);
+
+    if (old) {
+        // Cells the old interior covered keep their state, the rest get the
+        // vapor of their block
+        const int P = patchSettings->gridSize;
+        const int oldP = oldSettings->gridSize;
+        auto& grid = fine->snowflake;
+        const auto& oldGrid = old->snowflake;
+        for (int i = 0; i < P; ++i) {
+            for (int j = 0; j < P; ++j) {
+                const int x = i + offset - oldOffset;
+                const int y = j + offset - oldOffset;
+                if (x >= 1 && x < oldP - 1 && y >= 1 && y < oldP - 1) {
+                    grid.setCrystal(i, j, oldGrid.isCrystalAt(x, y));
+                    grid.setBoundary(i, j, oldGrid.isBoundaryAt(x, y));
+                    grid.boundaryMassAt(i, j) = oldGrid.boundaryMassAt(x, y);
+                    grid.crystalMassAt(i, j) = oldGrid.crystalMassAt(x, y);
+                    grid.diffusiveMassAt(i, j) = old->vaporAt(x, y);
+                } else {
+                    grid.setCrystal(i, j, false);
+                    grid.setBoundary(i, j, false);
+                    grid.boundaryMassAt(i, j) = 0.0f;
+                    grid.crystalMassAt(i, j) = 0.0f;
+                    grid.diffusiveMassAt(i, j) = old->progress().ambient + coarse[(i + offset) / factor][(j + offset) / factor];
+                }
+            }
+        }
+
+        // All of the new patch is active
+        ModelProgress progress = old->progress();
+        const int shift = oldOffset - offset;
+        progress.lowerRow = progress.lowerCol = 0;
+        progress.upperRow = progress.upperCol = P;
+        progress.crystalExtent.minRow += shift;
+        progress.crystalExtent.maxRow += shift;
+        progress.crystalExtent.minCol += shift;
+        progress.crystalExtent.maxCol += shift;
+        fine->resume(progress);
+        fine->phaseTimes = old->phaseTimes;
+        fine->stepTrace = old->stepTrace;
+    }
+
+    if (coupled) {
+        restrictPatch();
+        interpolateFrame();
+    }
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::time_step() {
+    if (hasReachedBoundary()) return;
+
+    syncSettings();
+    if (coupled && fine->hasReachedBoundary()) {
+        reflux();
+        buildPatch(2 * patchBlocks);
+    }
+
+    if (coupled) {
+        imposeFrame();
+    }
+    fine->time_step();
+
+    if (coupled && ++sinceCoarseStep >= factor * factor) {
+        reflux();
+        coarseStep();
+        restrictPatch();
+        interpolateFrame();
+        sinceCoarseStep = 0;
+    }
+}
+
+template <typename Patch>
+bool MultiresModel<Patch>::hasReachedBoundary() const {
+    // A coupled patch grows before the crystal gets near its frame
+    return !coupled && fine->hasReachedBoundary();
+}
+
+template <typename Patch>
+Extent MultiresModel<Patch>::getCrystalExtent() const {
+    Extent extent = fine->getCrystalExtent();
+    extent.minRow += offset;
+    extent.maxRow += offset;
+    extent.minCol += offset;
+    extent.maxCol += offset;
+    return extent;
+}
+
+template <typename Patch>
+float MultiresModel<Patch>::vaporAt(int i, int j) const {
+    const int P = patchSettings->gridSize;
+    const int edge = coupled ? 1 : 0;
+    const int x = i - offset;
+    const int y = j - offset;
+    if (x >= edge && x < P - edge && y >= edge && y < P - edge) {
+        return fine->vaporAt(x, y);
+    }
+    return ambient() + coarse[i / factor][j / factor];
+}
+
+template <typename Patch>
+double MultiresModel<Patch>::totalMass() const {
+    const int P = patchSettings->gridSize;
+    const int edge = coupled ? 1 : 0;
+    const auto& grid = fine->snowflake;
+    double mass = 0.0;
+    for (int i = edge; i < P - edge; ++i) {
+        for (int j = edge; j < P - edge; ++j) {
+            mass += fine->vaporAt(i, j) + grid.boundaryMassAt(i, j) + grid.crystalMassAt(i, j);
+        }
+    }
+    if (coupled) {
+        for (int I = 0; I < blocks; ++I) {
+            for (int J = 0; J < blocks; ++J) {
+                if (!isCovered(I, J)) mass += (static_cast<double>(ambient()) + coarse[I][J]) * factor * factor;
+            }
+        }
+    }
+    return mass;
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::imposeFrame() {
+    // Frame cells that already hold their vapor, typically the far field of
+    // the patch, are left alone so that its active region only grows where
+    // the vapor differs. Each interior neighbor of a frame cell that isn't
+    // crystal gains (frame - own) / 7 in the coming step.
+    const int P = patchSettings->gridSize;
+    const float far = ambient();
+    for (auto& [cell, relative] : frame) {
+        const float mass = far + relative;
+        if (fine->vaporAt(cell.first, cell.second) != mass) {
+            fine->setVapor(cell.first, cell.second, mass);
+        }
+    }
+    for (auto& [cell, relative] : frame) {
+        const float mass = far + relative;
+        double given = 0.0;
+        for (auto& neighbor : neighbors) {
+            const int i = cell.first + neighbor.first;
+            const int j = cell.second + neighbor.second;
+            if (i < 1 || i >= P - 1 || j < 1 || j >= P - 1 || fine->snowflake.isCrystalAt(i, j)) continue;
+            given += mass - fine->vaporAt(i, j);
+        }
+        inflow[(cell.first + offset) / factor][(cell.second + offset) / factor] += given / 7.0;
+    }
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::reflux() {
+    // Only the ring of blocks around the patch holds frame cells
+    const float perCell = 1.0f / (factor * factor);
+    lowBlock = std::min(lowBlock, firstBlock - 1);
+    highBlock = std::max(highBlock, firstBlock + patchBlocks + 1);
+    for (int I = firstBlock - 1; I <= firstBlock + patchBlocks; ++I) {
+        for (int J = firstBlock - 1; J <= firstBlock + patchBlocks; ++J) {
+            if (I < 0 || J < 0 || I >= blocks || J >= blocks) continue;
+            coarse[I][J] -= static_cast<float>(inflow[I][J]) * perCell;
+            inflow[I][J] = 0.0;
+        }
+    }
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::coarseStep() {
+    // The stencil of the fine grid, with covered blocks and the edge of the
+    // grid as walls, written as a sum of exchanges with the neighbors. Only
+    // the box of blocks that aren't zero and the ring around it can change;
+    // the box grows to take in any that do, and never shrinks, so both
+    // buffers stay zero outside of it.
+    const int begin = std::max(lowBlock - 1, 0);
+    const int end = std::min(highBlock + 1, blocks);
+    int low = lowBlock, high = highBlock;
+    for (int I = begin; I < end; ++I) {
+        for (int J = begin; J < end; ++J) {
+            const float own = coarse[I][J];
+            float exchange = 0.0f;
+            if (!isCovered(I, J)) {
+                for (auto& neighbor : neighbors) {
+                    const int a = I + neighbor.first;
+                    const int b = J + neighbor.second;
+                    const bool wall = a < 0 || b < 0 || a >= blocks || b >= blocks || isCovered(a, b);
+                    exchange += wall ? 0.0f : coarse[a][b] - own;
+                }
+            }
+            nextCoarse[I][J] = own + exchange / 7.0f;
+            if (nextCoarse[I][J] != 0.0f) {
+                low = std::min(low, std::min(I, J));
+                high = std::max(high, std::max(I, J) + 1);
+            }
+        }
+    }
+    lowBlock = low;
+    highBlock = high;
+    std::swap(coarse, nextCoarse);
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::restrictPatch() {
+    // Covered blocks hold the mean vapor of their cells, for interpolation
+    const float perCell = 1.0f / (factor * factor);
+    const float far = ambient();
+    for (int I = firstBlock; I < firstBlock + patchBlocks; ++I) {
+        for (int J = firstBlock; J < firstBlock + patchBlocks; ++J) {
+            double sum = 0.0;
+            for (int i = I * factor - offset; i < (I + 1) * factor - offset; ++i) {
+                for (int j = J * factor - offset; j < (J + 1) * factor - offset; ++j) {
+                    sum += fine->vaporAt(i, j);
+                }
+            }
+            coarse[I][J] = static_cast<float>(sum) * perCell - far;
+        }
+    }
+}
+
+template <typename Patch>
+void MultiresModel<Patch>::interpolateFrame() {
+    const int P = patchSettings->gridSize;
+    frame.clear();
+    for (int i = 0; i < P; ++i) {
+        const bool edgeRow = i == 0 || i == P - 1;
+        for (int j = 0; j < P; j += edgeRow ? 1 : P - 1) {
+            frame.push_back({{i, j}, interpolated(i + offset, j + offset)});
+        }
+    }
+}
+
+template <typename Patch>
+float MultiresModel<Patch>::interpolated(int i, int j) const {
+    // Bilinear between the centers of the four nearest blocks, clamped at
+    // the edge of the grid. Written so that equal blocks give their vapor
+    // exactly, which keeps a far field the patch hasn't disturbed inactive.
+    auto lerp = [](float a, float b, float weight) { return a + weight * (b - a); };
+    auto locate = [&](int cell, int& block, float& weight) {
+        const float at = (cell + 0.5f) / factor - 0.5f;
+        block = std::min(std::max(static_cast<int>(std::floor(at)), 0), blocks - 2);
+        weight = std::min(std::max(at - block, 0.0f), 1.0f);
+    };
+    int I, J;
+    float s, t;
+    locate(i, I, s);
+    locate(j, J, t);
+    return lerp(lerp(coarse[I][J], coarse[I][J + 1], t), lerp(coarse[I + 1][J], coarse[I + 1][J + 1], t), s);
+}
+
+#endif // GG_MULTIRES_H
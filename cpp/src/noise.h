@@ -0,0 +1,55 @@
+#ifndef GG_NOISE_H
+#define GG_NOISE_H
+
+#include <cstdint>
+
+// Counter-based random numbers for the sigma perturbation. Philox4x32-10
+// (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11) maps
+// a 128-bit counter and a 64-bit key to 128 random bits and keeps no state,
+// so a cell's noise only depends on the seed, the step and the cell, and
+// not on which thread computes it or in what order.
+struct Philox4x32 {
+    uint32_t words[4];
+};
+
+inline Philox4x32 philox4x32(Philox4x32 counter, uint32_t key0, uint32_t key1) {
+    for (int round = 0; round < 10; ++round) {
+        const uint64_t product0 = static_cast<uint64_t>(0xD2511F53u) * counter.words[0];
+        const uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57u) * counter.words[2];
+        counter = {{
+            static_cast<uint32_t>(product1 >> 32) ^ counter.words[1] ^ key0,
+            static_cast<uint32_t>(product1),
+            static_cast<uint32_t>(product0 >> 32) ^ counter.words[3] ^ key1,
+            static_cast<uint32_t>(product0)
+        }};
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    return counter;
+}
+
+// One random bit per cell: a Philox block covers 128 consecutive columns of
+// one row at one step. Rows and columns are full grid coordinates.
+class NoiseBits {
+    public:
+        NoiseBits(uint32_t seed, uint64_t step, int row) : seed(seed), step(step), row(row) {}
+
+        bool operator()(int col) {
+            const int block = col >> 7;
+            if (block != cachedBlock) {
+                bits = philox4x32({{static_cast<uint32_t>(block), static_cast<uint32_t>(row),
+                                    static_cast<uint32_t>(step), static_cast<uint32_t>(step >> 32)}},
+                                  seed, 0x736E6F77u);   // "snow"
+                cachedBlock = block;
+            }
+            return (bits.words[(col >> 5) & 3] >> (col & 31)) & 1;
+        }
+    private:
+        uint32_t seed;
+        uint64_t step;
+        int row;
+        int cachedBlock = -1;
+        Philox4x32 bits;
+};
+
+#endif // GG_NOISE_H
@@ -0,0 +1,52 @@
+#ifndef GG_PHASE_TIMING_H
+#define GG_PHASE_TIMING_H
+
+#include <chrono>
+#include <cstdint>
+
+// Time spent in each phase of BasicModel::time_step. Compile with
+// -DGG_PHASE_TIMING to have the model fill it in; otherwise the timers
+// compile to nothing and it stays zero.
+enum class Phase {
+    DIFFUSION,      // With freezing in the fused step
+    FREEZING,
+    ATTACHMENT,
+    MELTING,
+    NOISE,
+    BOUNDARY_CHECK, // hasReachedBoundary
+    COUNT
+};
+
+constexpr const char* PHASE_NAMES[] = {
+    "diffusion", "freezing", "attachment", "melting", "noise", "has_reached_boundary"
+};
+
+struct PhaseTimes {
+    double seconds[static_cast<int>(Phase::COUNT)] = {};
+    uint64_t calls[static_cast<int>(Phase::COUNT)] = {};
+
+    void reset() { *this = PhaseTimes(); }
+};
+
+// Adds the time until the end of its scope to one phase
+class PhaseTimer {
+    public:
+        PhaseTimer(PhaseTimes& times, Phase phase)
+            : times(times), phase(static_cast<int>(phase)), start(std::chrono::steady_clock::now()) {}
+        ~PhaseTimer() {
+            times.seconds[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            times.calls[phase]++;
+        }
+    private:
+        PhaseTimes& times;
+        int phase;
+        std::chrono::steady_clock::time_point start;
+};
+
+#ifdef GG_PHASE_TIMING
+#define GG_TIME_PHASE(times, phase) PhaseTimer phaseTimer(times, phase)
+#else
+#define GG_TIME_PHASE(times, phase)
+#endif
+
+#endif // GG_PHASE_TIMING_H
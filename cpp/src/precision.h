@@ -0,0 +1,118 @@
+#ifndef GG_PRECISION_H
+#define GG_PRECISION_H
+
+#include <cstdint>
+#include <cstring>
+
+// 16-bit encodings for the mass fields of CompactGrid. Masses are computed in
+// float as usual and only rounded (to nearest) when they are stored.
+
+// IEEE half float: 11 significant bits at any magnitude, so the relative
+// error stays below 2^-11, and small masses keep their precision
+struct HalfCodec {
+    using Storage = uint16_t;
+
+    static float decode(uint16_t half) {
+        // Shift exponent and mantissa into place, then rebias the exponent
+        const uint32_t shiftedExponent = 0x7c00u << 13;
+        uint32_t bits = (half & 0x7fffu) << 13;
+        const uint32_t exponent = bits & shiftedExponent;
+        bits += (127 - 15) << 23;
+        float value;
+        if (exponent == shiftedExponent) {
+            bits += (128 - 16) << 23;   // Inf and NaN
+            std::memcpy(&value, &bits, sizeof(value));
+        } else if (exponent == 0) {
+            bits += 1 << 23;            // Subnormal: renormalize
+            std::memcpy(&value, &bits, sizeof(value));
+            value -= 6.10351562e-05f;   // 2^-14
+        } else {
+            std::memcpy(&value, &bits, sizeof(value));
+        }
+
+        uint32_t result;
+        std::memcpy(&result, &value, sizeof(result));
+        result |= static_cast<uint32_t>(half & 0x8000u) << 16;
+        std::memcpy(&value, &result, sizeof(value));
+        return value;
+    }
+
+    static uint16_t encode(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint32_t sign = bits & 0x80000000u;
+        bits ^= sign;
+
+        uint32_t half;
+        if (bits >= (127 + 16) << 23) {
+            half = bits > 0x7f800000u ? 0x7e00 : 0x7c00;   // NaN, or too large: Inf
+        } else if (bits < (127 - 14) << 23) {
+            // Subnormal or zero: adding 2^-1 lets the FPU do the rounding
+            const uint32_t magicBits = (127 - 1) << 23;
+            float magic, rounded;
+            std::memcpy(&magic, &magicBits, sizeof(magic));
+            std::memcpy(&rounded, &bits, sizeof(rounded));
+            rounded += magic;
+            std::memcpy(&half, &rounded, sizeof(half));
+            half -= magicBits;
+        } else {
+            // Round to nearest even on the 13 dropped mantissa bits
+            const uint32_t odd = (bits >> 13) & 1;
+            bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + odd;
+            half = bits >> 13;
+        }
+        return static_cast<uint16_t>(half | (sign >> 16));
+    }
+};
+
+// Unsigned fixed point with FractionBits fractional bits: a constant step of
+// 2^-FractionBits over [0, 2^(16 - FractionBits)), saturating at both ends
+template <int FractionBits>
+struct FixedCodec {
+    using Storage = uint16_t;
+    static constexpr float SCALE = static_cast<float>(1 << FractionBits);
+
+    static float decode(uint16_t fixed) {
+        return fixed * (1.0f / SCALE);
+    }
+
+    static uint16_t encode(float value) {
+        const float scaled = value * SCALE + 0.5f;
+        if (!(scaled > 0.0f)) return 0;
+        if (scaled >= 65535.0f) return 65535;
+        return static_cast<uint16_t>(scaled);
+    }
+};
+
+// Reference to one encoded mass that reads and writes like a float&, so the
+// model can update masses in place whatever the storage
+template <typename Codec>
+class MassRef {
+    public:
+        explicit MassRef(typename Codec::Storage& stored) : stored(stored) {}
+
+        operator float() const { return Codec::decode(stored); }
+        MassRef& operator=(float mass) { stored = Codec::encode(mass); return *this; }
+        MassRef& operator=(const MassRef& other) { return *this = static_cast<float>(other); }
+        MassRef& operator+=(float mass) { return *this = static_cast<float>(*this) + mass; }
+        MassRef& operator-=(float mass) { return *this = static_cast<float>(*this) - mass; }
+        MassRef& operator*=(float factor) { return *this = static_cast<float>(*this) * factor; }
+    private:
+        typename Codec::Storage& stored;
+};
+
+// Encodings for the vapor (diffusive mass) and the crystal mass. Vapor stays
+// below about 1 and feeds the theta test, so the fixed-point format spends
+// all but one bit on the fraction (steps of 3e-5, theta is at least 1e-3).
+// Crystal mass reaches beta + 1 or so.
+struct HalfPrecision {
+    using Vapor = HalfCodec;
+    using Solid = HalfCodec;
+};
+
+struct FixedPrecision {
+    using Vapor = FixedCodec<15>;   // [0, 2)
+    using Solid = FixedCodec<13>;   // [0, 8)
+};
+
+#endif // GG_PRECISION_H
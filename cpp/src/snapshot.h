@@ -0,0 +1,561 @@
+#ifndef GG_SNAPSHOT_H
+#define GG_SNAPSHOT_H
+
+#include "gg_model.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GG_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Checkpoint files. A snapshot holds the settings, the model's progress and
+// the stored grid (the wedge in symmetric mode), which is everything needed
+// to resume a run bit for bit.
+//
+// Layout, little endian: a SnapshotHeader, a table of SnapshotSection, then
+// the sections, each starting on a 64 byte boundary so that a mapped file
+// can be read in place. Cells are numbered row by row through the domain's
+// row extents. Per section:
+//   DOMAIN          rows x {begin, end}, int32
+//   CRYSTAL, BOUNDARY
+//                   RUNS: count runs of set cells, {first cell, length} uint32
+//   BOUNDARY_MASS, CRYSTAL_MASS
+//                   SPARSE: count runs of cells other than +0, as above,
+//                   then the values of all those cells, float
+//   DIFFUSIVE_MASS  RLE: count {length, value} pairs, uint32 and float
+//                   (the far field and the crystal are long runs), or RAW:
+//                   one float per cell
+constexpr char SNAPSHOT_MAGIC[8] = {'G', 'G', 'S', 'N', 'A', 'P', 0, 0};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+enum class SectionKind : uint32_t {
+    DOMAIN, CRYSTAL, BOUNDARY, BOUNDARY_MASS, CRYSTAL_MASS, DIFFUSIVE_MASS
+};
+
+enum class SectionEncoding : uint32_t {
+    RAW, RUNS, SPARSE, RLE
+};
+
+struct SnapshotSection {
+    uint32_t kind;
+    uint32_t encoding;
+    uint64_t offset;    // From the start of the file
+    uint64_t bytes;
+    uint64_t count;     // Runs, pairs or values (see above)
+};
+
+// ModelSettings and ModelProgress with fixed sizes
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+
+    int32_t gridSize;
+    float rho, beta, kappa, mu, gamma, theta, sigma, alpha;
+    uint32_t seed;
+    uint8_t useSymmetry, hexDomain, fusedStep, simdDiffusion;
+    int32_t boundaryMargin, vaporHalo, threads;
+
+    uint64_t steps;
+    int32_t lowerRow, upperRow, lowerCol, upperCol;
+    float ambient;
+    int32_t minRow, maxRow, minCol, maxCol;
+    int32_t crystalReach;
+
+    uint32_t rows;
+    uint32_t reserved;
+    uint64_t cells;
+};
+
+static_assert(sizeof(SnapshotHeader) == 136 && sizeof(SnapshotSection) == 32, "snapshot structs must not be padded");
+
+namespace snapshot_detail {
+
+constexpr size_t ALIGNMENT = 64;
+
+inline void append(std::vector<uint8_t>& out, const void* data, size_t bytes) {
+    const uint8_t* begin = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), begin, begin + bytes);
+}
+
+// Runs of the cells where set(k) holds, as {first, length} pairs
+template <typename Predicate>
+std::vector<uint32_t> runsOf(uint64_t cells, Predicate set) {
+    std::vector<uint32_t> runs;
+    for (uint64_t k = 0; k < cells; ++k) {
+        if (!set(k)) continue;
+        if (!runs.empty() && runs[runs.size() - 2] + runs.back() == k) {
+            runs.back()++;
+        } else {
+            runs.push_back(static_cast<uint32_t>(k));
+            runs.push_back(1);
+        }
+    }
+    return runs;
+}
+
+inline bool sameBits(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+} // namespace snapshot_detail
+
+// Writes a snapshot of model to path (through a temporary file, so an
+// existing checkpoint is only replaced once the new one is complete).
+// compress run-length encodes the vapor where that saves space. Returns
+// false if writing failed.
+template <typename Layout>
+bool saveSnapshot(const std::string& path, BasicModel<Layout>& model, bool compress = true) {
+    using namespace snapshot_detail;
+
+    // Cells outside the active region may hold stale vapor
+    model.syncFarField();
+    const ModelSettings& settings = model.getSettings();
+    const ModelProgress progress = model.progress();
+    const Layout& grid = model.snowflake;
+    const Domain& domain = grid.domain;
+
+    std::vector<Point> cells;
+    for (int i = 0; i < domain.rows(); ++i) {
+        for (int j = domain[i].begin; j < domain[i].end; ++j) {
+            cells.push_back({i, j});
+        }
+    }
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.gridSize = settings.gridSize;
+    header.rho = settings.rho;
+    header.beta = settings.beta;
+    header.kappa = settings.kappa;
+    header.mu = settings.mu;
+    header.gamma = settings.gamma;
+    header.theta = settings.theta;
+    header.sigma = settings.sigma;
+    header.alpha = settings.alpha;
+    header.seed = settings.seed;
+    header.useSymmetry = settings.useSymmetry;
+    header.hexDomain = settings.hexDomain;
+    header.fusedStep = settings.fusedStep;
+    header.simdDiffusion = settings.simdDiffusion;
+    header.boundaryMargin = settings.boundaryMargin;
+    header.vaporHalo = settings.vaporHalo;
+    header.threads = settings.threads;
+    header.steps = progress.steps;
+    header.lowerRow = progress.lowerRow;
+    header.upperRow = progress.upperRow;
+    header.lowerCol = progress.lowerCol;
+    header.upperCol = progress.upperCol;
+    header.ambient = progress.ambient;
+    header.minRow = progress.crystalExtent.minRow;
+    header.maxRow = progress.crystalExtent.maxRow;
+    header.minCol = progress.crystalExtent.minCol;
+    header.maxCol = progress.crystalExtent.maxCol;
+    header.crystalReach = progress.crystalReach;
+    header.rows = static_cast<uint32_t>(domain.rows());
+    header.cells = cells.size();
+
+    // Section payloads, laid out after the header and the table
+    std::vector<SnapshotSection> table;
+    std::vector<std::vector<uint8_t>> payloads;
+    auto addSection = [&](SectionKind kind, SectionEncoding encoding, uint64_t count, std::vector<uint8_t> payload) {
+        table.push_back({static_cast<uint32_t>(kind), static_cast<uint32_t>(encoding), 0, payload.size(), count});
+        payloads.push_back(std::move(payload));
+    };
+
+    std::vector<uint8_t> payload;
+    for (auto& extent : domain.extents) {
+        const int32_t range[2] = {extent.begin, extent.end};
+        append(payload, range, sizeof(range));
+    }
+    addSection(SectionKind::DOMAIN, SectionEncoding::RAW, domain.rows(), std::move(payload));
+
+    auto addFlags = [&](SectionKind kind, auto set) {
+        const std::vector<uint32_t> runs = runsOf(cells.size(), [&](uint64_t k) { return set(cells[k]); });
+        std::vector<uint8_t> bytes;
+        append(bytes, runs.data(), runs.size() * sizeof(uint32_t));
+        addSection(kind, SectionEncoding::RUNS, runs.size() / 2, std::move(bytes));
+    };
+    addFlags(SectionKind::CRYSTAL, [&](Point c) { return grid.isCrystalAt(c.first, c.second); });
+    addFlags(SectionKind::BOUNDARY, [&](Point c) { return grid.isBoundaryAt(c.first, c.second); });
+
+    auto addSparse = [&](SectionKind kind, auto value) {
+        const std::vector<uint32_t> runs = runsOf(cells.size(), [&](uint64_t k) { return !sameBits(value(cells[k]), 0.0f); });
+        std::vector<uint8_t> bytes;
+        append(bytes, runs.data(), runs.size() * sizeof(uint32_t));
+        for (size_t r = 0; r < runs.size(); r += 2) {
+            for (uint32_t k = runs[r]; k < runs[r] + runs[r + 1]; ++k) {
+                const float mass = value(cells[k]);
+                append(bytes, &mass, sizeof(mass));
+            }
+        }
+        addSection(kind, SectionEncoding::SPARSE, runs.size() / 2, std::move(bytes));
+    };
+    addSparse(SectionKind::BOUNDARY_MASS, [&](Point c) { return grid.boundaryMassAt(c.first, c.second); });
+    addSparse(SectionKind::CRYSTAL_MASS, [&](Point c) { return grid.crystalMassAt(c.first, c.second); });
+
+    // Run-length encoded vapor, unless that ends up larger than storing it
+    // raw (under noise, say)
+    payload.clear();
+    uint64_t pairs = 0;
+    uint32_t length = 0;
+    float value = 0.0f;
+    auto endRun = [&]() {
+        append(payload, &length, sizeof(length));
+        append(payload, &value, sizeof(value));
+        pairs++;
+    };
+    for (size_t k = 0; compress && k < cells.size() && payload.size() < cells.size() * sizeof(float); ++k) {
+        const float mass = grid.diffusiveMassAt(cells[k].first, cells[k].second);
+        if (length > 0 && sameBits(value, mass)) {
+            length++;
+        } else {
+            if (length > 0) endRun();
+            value = mass;
+            length = 1;
+        }
+    }
+    if (length > 0) endRun();
+    if (compress && payload.size() < cells.size() * sizeof(float)) {
+        addSection(SectionKind::DIFFUSIVE_MASS, SectionEncoding::RLE, pairs, std::move(payload));
+    } else {
+        payload.clear();
+        for (auto& [i, j] : cells) {
+            const float mass = grid.diffusiveMassAt(i, j);
+            append(payload, &mass, sizeof(mass));
+        }
+        addSection(SectionKind::DIFFUSIVE_MASS, SectionEncoding::RAW, cells.size(), std::move(payload));
+    }
+
+    header.sectionCount = static_cast<uint32_t>(table.size());
+    uint64_t offset = sizeof(SnapshotHeader) + table.size() * sizeof(SnapshotSection);
+    for (auto& section : table) {
+        offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        section.offset = offset;
+        offset += section.bytes;
+    }
+
+    const std::string temporary = path + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file) return false;
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   std::fwrite(table.data(), sizeof(SnapshotSection), table.size(), file) == table.size();
+    uint64_t position = sizeof(SnapshotHeader) + table.size() * sizeof(SnapshotSection);
+    const uint8_t padding[ALIGNMENT] = {};
+    for (size_t s = 0; s < table.size() && written; ++s) {
+        written = std::fwrite(padding, 1, table[s].offset - position, file) == table[s].offset - position &&
+                  std::fwrite(payloads[s].data(), 1, payloads[s].size(), file) == payloads[s].size();
+        position = table[s].offset + table[s].bytes;
+    }
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// A snapshot file mapped into memory. Opening only checks the header and
+// the section table; the sections are read in place when the grid is
+// restored or inspected.
+class Snapshot {
+    public:
+        // nullptr (and a reason in error) if path isn't a readable snapshot
+        static std::unique_ptr<Snapshot> open(const std::string& path, std::string& error);
+        ~Snapshot();
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        const SnapshotHeader& header() const { return head; }
+        const std::vector<SnapshotSection>& sections() const { return table; }
+        uint64_t fileBytes() const { return size; }
+        ModelSettings settings() const;
+        ModelProgress progress() const;
+        Domain domain() const;
+        uint64_t crystalSites() const;
+
+        // Loads the grid and progress into model, which has to be set up with
+        // settings() (the thread count may differ). False if its grid has a
+        // different shape.
+        template <typename Layout>
+        bool restore(BasicModel<Layout>& model) const;
+    private:
+        Snapshot() = default;
+        const uint8_t* data = nullptr;
+        uint64_t size = 0;
+        bool mapped = false;
+        std::vector<uint8_t> buffer;    // Without mmap the file is read into memory
+        SnapshotHeader head;
+        std::vector<SnapshotSection> table;
+
+        const SnapshotSection* find(SectionKind kind) const;
+        template <typename T>
+        const T* at(const SnapshotSection& section) const {
+            return reinterpret_cast<const T*>(data + section.offset);
+        }
+        template <typename Visit>
+        void forEachRun(const SnapshotSection& section, Visit visit) const;
+};
+
+inline std::unique_ptr<Snapshot> Snapshot::open(const std::string& path, std::string& error) {
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+
+#ifdef GG_HAS_MMAP
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+        if (descriptor >= 0) ::close(descriptor);
+        error = "can't open " + path;
+        return nullptr;
+    }
+    snapshot->size = static_cast<uint64_t>(status.st_size);
+    if (snapshot->size > 0) {
+        void* map = mmap(nullptr, snapshot->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (map != MAP_FAILED) {
+            snapshot->data = static_cast<const uint8_t*>(map);
+            snapshot->mapped = true;
+        }
+    }
+    ::close(descriptor);
+#endif
+
+    if (!snapshot->mapped) {
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            error = "can't open " + path;
+            return nullptr;
+        }
+        std::fseek(file, 0, SEEK_END);
+        snapshot->buffer.resize(static_cast<size_t>(std::ftell(file)));
+        std::fseek(file, 0, SEEK_SET);
+        const bool read = std::fread(snapshot->buffer.data(), 1, snapshot->buffer.size(), file) == snapshot->buffer.size();
+        std::fclose(file);
+        if (!read) {
+            error = "can't read " + path;
+            return nullptr;
+        }
+        snapshot->data = snapshot->buffer.data();
+        snapshot->size = snapshot->buffer.size();
+    }
+
+    SnapshotHeader& head = snapshot->head;
+    if (snapshot->size < sizeof(SnapshotHeader)) {
+        error = path + " is too short for a snapshot";
+        return nullptr;
+    }
+    std::memcpy(&head, snapshot->data, sizeof(head));
+    if (std::memcmp(head.magic, SNAPSHOT_MAGIC, sizeof(head.magic)) != 0) {
+        error = path + " is not a snapshot";
+        return nullptr;
+    }
+    if (head.version != SNAPSHOT_VERSION) {
+        error = path + " has snapshot version " + std::to_string(head.version) +
+                ", expected " + std::to_string(SNAPSHOT_VERSION);
+        return nullptr;
+    }
+
+    const uint64_t tableEnd = sizeof(SnapshotHeader) + uint64_t(head.sectionCount) * sizeof(SnapshotSection);
+    if (tableEnd > snapshot->size) {
+        error = path + " is truncated";
+        return nullptr;
+    }
+    snapshot->table.resize(head.sectionCount);
+    std::memcpy(snapshot->table.data(), snapshot->data + sizeof(SnapshotHeader),
+                head.sectionCount * sizeof(SnapshotSection));
+    for (auto& section : snapshot->table) {
+        if (section.offset % snapshot_detail::ALIGNMENT != 0 || section.offset > snapshot->size ||
+            section.bytes > snapshot->size - section.offset) {
+            error = path + " is truncated";
+            return nullptr;
+        }
+    }
+    for (uint32_t kind = 0; kind <= static_cast<uint32_t>(SectionKind::DIFFUSIVE_MASS); ++kind) {
+        if (!snapshot->find(static_cast<SectionKind>(kind))) {
+            error = path + " lacks section " + std::to_string(kind);
+            return nullptr;
+        }
+    }
+    // The domain has to be the one the settings give, and the saved region
+    // and extent have to lie in it: resume() sweeps them as they are
+    const int32_t N = head.gridSize;
+    const int64_t rows = head.useSymmetry ? int64_t(N) + 1 - N / 2 : N;
+    if (N <= 0 || head.rows != rows ||
+        snapshot->find(SectionKind::DOMAIN)->bytes != uint64_t(head.rows) * 2 * sizeof(int32_t)) {
+        error = path + " has a malformed domain";
+        return nullptr;
+    }
+    const Domain expected = head.useSymmetry ? wedgeDomain(N) : gridDomain(snapshot->settings());
+    const int32_t* ranges = snapshot->at<int32_t>(*snapshot->find(SectionKind::DOMAIN));
+    int32_t cols = 0;
+    for (uint32_t i = 0; i < head.rows; ++i) {
+        if (ranges[2 * i] != expected[i].begin || ranges[2 * i + 1] != expected[i].end) {
+            error = path + " has a malformed domain";
+            return nullptr;
+        }
+        cols = std::max(cols, ranges[2 * i + 1]);
+    }
+    if (head.lowerRow < 0 || head.lowerRow > head.upperRow || head.upperRow > rows ||
+        head.lowerCol < 0 || head.lowerCol > head.upperCol || head.upperCol > cols ||
+        head.minRow < 0 || head.minRow > head.maxRow || head.maxRow >= N ||
+        head.minCol < 0 || head.minCol > head.maxCol || head.maxCol >= N ||
+        head.crystalReach < 0 || head.crystalReach > N) {
+        error = path + " has a malformed domain";
+        return nullptr;
+    }
+    return snapshot;
+}
+
+inline Snapshot::~Snapshot() {
+#ifdef GG_HAS_MMAP
+    if (mapped) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+#endif
+}
+
+inline const SnapshotSection* Snapshot::find(SectionKind kind) const {
+    for (auto& section : table) {
+        if (section.kind == static_cast<uint32_t>(kind)) return &section;
+    }
+    return nullptr;
+}
+
+inline ModelSettings Snapshot::settings() const {
+    ModelSettings settings;
+    settings.gridSize = head.gridSize;
+    settings.rho = head.rho;
+    settings.beta = head.beta;
+    settings.kappa = head.kappa;
+    settings.mu = head.mu;
+    settings.gamma = head.gamma;
+    settings.theta = head.theta;
+    settings.sigma = head.sigma;
+    settings.alpha = head.alpha;
+    settings.seed = head.seed;
+    settings.useSymmetry = head.useSymmetry;
+    settings.hexDomain = head.hexDomain;
+    settings.fusedStep = head.fusedStep;
+    settings.simdDiffusion = head.simdDiffusion;
+    settings.boundaryMargin = head.boundaryMargin;
+    settings.vaporHalo = head.vaporHalo;
+    settings.threads = head.threads;
+    return settings;
+}
+
+inline ModelProgress Snapshot::progress() const {
+    return {head.steps, head.lowerRow, head.upperRow, head.lowerCol, head.upperCol, head.ambient,
+            {head.minRow, head.maxRow, head.minCol, head.maxCol}, head.crystalReach};
+}
+
+inline Domain Snapshot::domain() const {
+    const int32_t* ranges = at<int32_t>(*find(SectionKind::DOMAIN));
+    Domain domain = {std::vector<RowExtent>(head.rows)};
+    for (uint32_t i = 0; i < head.rows; ++i) {
+        domain.extents[i] = {ranges[2 * i], ranges[2 * i + 1]};
+    }
+    return domain;
+}
+
+template <typename Visit>
+void Snapshot::forEachRun(const SnapshotSection& section, Visit visit) const {
+    // Runs past the end of the grid are dropped rather than trusted
+    const uint32_t* runs = at<uint32_t>(section);
+    const uint64_t count = std::min<uint64_t>(section.count, section.bytes / (2 * sizeof(uint32_t)));
+    for (uint64_t r = 0; r < count; ++r) {
+        const uint64_t first = runs[2 * r];
+        const uint64_t last = std::min<uint64_t>(first + runs[2 * r + 1], head.cells);
+        if (first < last) visit(first, last);
+    }
+}
+
+inline uint64_t Snapshot::crystalSites() const {
+    uint64_t sites = 0;
+    forEachRun(*find(SectionKind::CRYSTAL), [&](uint64_t first, uint64_t last) { sites += last - first; });
+    return sites;
+}
+
+template <typename Layout>
+bool Snapshot::restore(BasicModel<Layout>& model) const {
+    Layout& grid = model.snowflake;
+    const Domain domain = this->domain();
+    if (domain.rows() != grid.domain.rows()) return false;
+    std::vector<Point> cells;
+    for (int i = 0; i < domain.rows(); ++i) {
+        if (domain[i].begin != grid.domain[i].begin || domain[i].end != grid.domain[i].end) return false;
+        for (int j = domain[i].begin; j < domain[i].end; ++j) {
+            cells.push_back({i, j});
+        }
+    }
+    if (cells.size() != head.cells) return false;
+
+    // Everything not listed in a sparse section is zero
+    for (auto& [i, j] : cells) {
+        grid.setCrystal(i, j, false);
+        grid.setBoundary(i, j, false);
+        grid.boundaryMassAt(i, j) = 0.0f;
+        grid.crystalMassAt(i, j) = 0.0f;
+    }
+
+    forEachRun(*find(SectionKind::CRYSTAL), [&](uint64_t first, uint64_t last) {
+        for (uint64_t k = first; k < last; ++k) grid.setCrystal(cells[k].first, cells[k].second, true);
+    });
+    forEachRun(*find(SectionKind::BOUNDARY), [&](uint64_t first, uint64_t last) {
+        for (uint64_t k = first; k < last; ++k) grid.setBoundary(cells[k].first, cells[k].second, true);
+    });
+
+    auto readSparse = [&](SectionKind kind, auto store) {
+        const SnapshotSection& section = *find(kind);
+        const float* values = at<float>(section) + 2 * section.count;
+        const uint64_t available = section.bytes / sizeof(float) - std::min<uint64_t>(2 * section.count, section.bytes / sizeof(float));
+        uint64_t v = 0;
+        forEachRun(section, [&](uint64_t first, uint64_t last) {
+            for (uint64_t k = first; k < last && v < available; ++k) store(cells[k], values[v++]);
+        });
+    };
+    readSparse(SectionKind::BOUNDARY_MASS, [&](Point c, float mass) { grid.boundaryMassAt(c.first, c.second) = mass; });
+    readSparse(SectionKind::CRYSTAL_MASS, [&](Point c, float mass) { grid.crystalMassAt(c.first, c.second) = mass; });
+
+    // Far-field cells were saved holding the ambient vapor, which then
+    // leaves their tiles missing
+    if constexpr (isTiledGrid<Layout>) {
+        grid.farVapor = progress().ambient;
+    }
+
+    const SnapshotSection& vapor = *find(SectionKind::DIFFUSIVE_MASS);
+    if (vapor.encoding == static_cast<uint32_t>(SectionEncoding::RAW)) {
+        const float* values = at<float>(vapor);
+        const uint64_t count = std::min<uint64_t>(head.cells, vapor.bytes / sizeof(float));
+        for (uint64_t k = 0; k < count; ++k) {
+            grid.diffusiveMassAt(cells[k].first, cells[k].second) = values[k];
+        }
+    } else {
+        const uint8_t* pairs = at<uint8_t>(vapor);
+        const uint64_t count = std::min<uint64_t>(vapor.count, vapor.bytes / 8);
+        uint64_t k = 0;
+        for (uint64_t p = 0; p < count; ++p) {
+            uint32_t length;
+            float mass;
+            std::memcpy(&length, pairs + 8 * p, sizeof(length));
+            std::memcpy(&mass, pairs + 8 * p + 4, sizeof(mass));
+            for (uint32_t n = 0; n < length && k < head.cells; ++n, ++k) {
+                grid.diffusiveMassAt(cells[k].first, cells[k].second) = mass;
+            }
+        }
+    }
+
+    model.resume(progress());
+    return true;
+}
+
+#endif // GG_SNAPSHOT_H
@@ -0,0 +1,104 @@
+#ifndef GG_THREAD_POOL_H
+#define GG_THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Emscripten only has std::thread in pthreads builds
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define GG_HAS_THREADS 1
+#endif
+
+// Persistent pool of worker threads. run(task) calls task(band) once for
+// every band in [0, size()), band 0 on the calling thread, and returns when
+// all of them are done, so consecutive runs are separated by a barrier.
+class ThreadPool {
+    public:
+        explicit ThreadPool(int threads);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        int size() const { return threadCount; }
+
+        template <typename Task>
+        void run(Task& task);
+    private:
+        int threadCount;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        uint64_t generation = 0;
+        int pending = 0;
+        bool stopping = false;
+
+        // Type-erased task, so that running one does not allocate
+        void (*job)(void*, int) = nullptr;
+        void* jobContext = nullptr;
+
+        void dispatch();
+        void workerLoop(int band);
+};
+
+ThreadPool::ThreadPool(int threads) : threadCount(threads < 1 ? 1 : threads) {
+    for (int band = 1; band < threadCount; ++band) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, band);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+template <typename Task>
+void ThreadPool::run(Task& task) {
+    job = [](void* context, int band) { (*static_cast<Task*>(context))(band); };
+    jobContext = &task;
+    dispatch();
+}
+
+void ThreadPool::dispatch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generation;
+        pending = threadCount - 1;
+    }
+    wake.notify_all();
+
+    job(jobContext, 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+}
+
+void ThreadPool::workerLoop(int band) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        job(jobContext, band);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) {
+            done.notify_one();
+        }
+    }
+}
+
+#endif // GG_THREAD_POOL_H
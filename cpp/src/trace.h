@@ -0,0 +1,164 @@
+#ifndef GG_TRACE_H
+#define GG_TRACE_H
+
+// Compile with -DGG_TRACE to have the model record every step and the
+// visualizer every frame into fixed-size rings (which also turns on the
+// phase timers). Without it the rings stay empty and allocate nothing.
+#if defined(GG_TRACE) && !defined(GG_PHASE_TIMING)
+#define GG_PHASE_TIMING
+#endif
+
+#include "phase_timing.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+constexpr size_t TRACE_CAPACITY = 1024;    // Records kept per ring
+
+// Microseconds since the first call, the time base of all records
+inline double traceMicros() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+struct StepRecord {
+    uint64_t step;
+    double startUs;
+    float stepMs;                                   // All of time_step
+    float phaseMs[static_cast<int>(Phase::COUNT)];
+    uint32_t cellsVisited;  // Cells of the active region at the start of the step
+    uint32_t attachments;   // Sites that attached (wedge sites in symmetric mode)
+};
+
+struct FrameRecord {
+    uint64_t frame;
+    double startUs;
+    float renderMs;         // All of Visualizer::draw, presenting included
+};
+
+// The last TRACE_CAPACITY records, oldest first
+template <typename Record>
+class TraceRing {
+    public:
+        void push(const Record& record) {
+            if (records.size() < TRACE_CAPACITY) {
+                records.push_back(record);
+            } else {
+                records[pushed % TRACE_CAPACITY] = record;
+            }
+            pushed++;
+        }
+        size_t size() const { return records.size(); }
+        // Records pushed so far, including the ones overwritten since
+        uint64_t total() const { return pushed; }
+        const Record& operator[](size_t k) const {
+            return records[records.size() < TRACE_CAPACITY ? k : (pushed + k) % TRACE_CAPACITY];
+        }
+        // Mean of field(record) over the last count records (0 if there are none)
+        template <typename Field>
+        double mean(size_t count, Field field) const {
+            count = std::min(count, size());
+            double sum = 0.0;
+            for (size_t k = size() - count; k < size(); ++k) {
+                sum += field((*this)[k]);
+            }
+            return count > 0 ? sum / count : 0.0;
+        }
+        void clear() {
+            records.clear();
+            pushed = 0;
+        }
+    private:
+        std::vector<Record> records;
+        uint64_t pushed = 0;
+};
+
+// The record of a step that began at startUs, from the phase times before and after it
+inline StepRecord stepRecord(uint64_t step, double startUs, const PhaseTimes& before, const PhaseTimes& after,
+                             size_t cellsVisited, size_t attachments) {
+    StepRecord record = {};
+    record.step = step;
+    record.startUs = startUs;
+    record.stepMs = static_cast<float>((traceMicros() - startUs) * 1e-3);
+    for (int p = 0; p < static_cast<int>(Phase::COUNT); ++p) {
+        record.phaseMs[p] = static_cast<float>((after.seconds[p] - before.seconds[p]) * 1e3);
+    }
+    record.cellsVisited = static_cast<uint32_t>(cellsVisited);
+    record.attachments = static_cast<uint32_t>(attachments);
+    return record;
+}
+
+// Streams the rings to a file in the Chrome trace event format (open it in
+// Perfetto or chrome://tracing). Each append writes the records pushed
+// since the last one that are still in the rings. Phases are drawn end to
+// end inside their step, the boundary check first. The closing bracket is
+// optional in this format, so the file is readable even if the program dies.
+class TraceFile {
+    public:
+        explicit TraceFile(const std::string& path) : file(std::fopen(path.c_str(), "w")) {
+            if (!file) return;
+            std::fputs("[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"simulation\"}},\n"
+                       "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"render\"}},\n", file);
+        }
+        ~TraceFile() {
+            if (!file) return;
+            std::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"gg-snowflakes\"}}]\n", file);
+            std::fclose(file);
+        }
+        TraceFile(const TraceFile&) = delete;
+        TraceFile& operator=(const TraceFile&) = delete;
+
+        bool isOpen() const { return file != nullptr; }
+
+        void append(const TraceRing<StepRecord>& steps, const TraceRing<FrameRecord>& frames) {
+            if (!file) return;
+            for (size_t k = unwritten(steps, stepsWritten); k < steps.size(); ++k) {
+                writeStep(steps[k]);
+            }
+            for (size_t k = unwritten(frames, framesWritten); k < frames.size(); ++k) {
+                const FrameRecord& r = frames[k];
+                std::fprintf(file, "{\"name\":\"draw\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,"
+                                   "\"args\":{\"frame\":%llu}},\n",
+                             r.startUs, r.renderMs * 1e3, static_cast<unsigned long long>(r.frame));
+            }
+            std::fflush(file);
+        }
+    private:
+        std::FILE* file;
+        uint64_t stepsWritten = 0, framesWritten = 0;
+
+        // Index of the first record not written yet. A ring that was cleared
+        // (a new model) starts over.
+        template <typename Record>
+        static size_t unwritten(const TraceRing<Record>& ring, uint64_t& written) {
+            if (ring.total() < written) written = 0;
+            const uint64_t fresh = std::min<uint64_t>(ring.total() - written, ring.size());
+            written = ring.total();
+            return ring.size() - static_cast<size_t>(fresh);
+        }
+
+        void writeStep(const StepRecord& r) {
+            std::fprintf(file, "{\"name\":\"step\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,"
+                               "\"args\":{\"step\":%llu,\"cells_visited\":%u,\"attachments\":%u}},\n",
+                         r.startUs, r.stepMs * 1e3, static_cast<unsigned long long>(r.step), r.cellsVisited, r.attachments);
+            std::fprintf(file, "{\"name\":\"step stats\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+                               "\"args\":{\"cells_visited\":%u,\"attachments\":%u}},\n",
+                         r.startUs, r.cellsVisited, r.attachments);
+
+            const int order[] = {static_cast<int>(Phase::BOUNDARY_CHECK), static_cast<int>(Phase::DIFFUSION),
+                                 static_cast<int>(Phase::FREEZING), static_cast<int>(Phase::ATTACHMENT),
+                                 static_cast<int>(Phase::MELTING), static_cast<int>(Phase::NOISE)};
+            double ts = r.startUs;
+            for (int p : order) {
+                if (r.phaseMs[p] <= 0.0f) continue;
+                std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f},\n",
+                             PHASE_NAMES[p], ts, r.phaseMs[p] * 1e3);
+                ts += r.phaseMs[p] * 1e3;
+            }
+        }
+};
+
+#endif // GG_TRACE_H
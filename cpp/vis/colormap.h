@@ -2,7 +2,6 @@
 #define GG_COLORMAP_H
 
 #include "../src/gg_model.h"
-#include <SDL3/SDL.h>
 #include <algorithm>
 #include <cstdint>
 #include <cmath>
@@ -48,39 +47,36 @@ inline void buildColorLUT(uint8_t redLUT[LUT_SIZE],
     }
 }
 
-// Global LUTs
+// Global LUTs, built on first use (from whichever thread draws first)
 static uint8_t redLUT[LUT_SIZE];
 static uint8_t greenLUT[LUT_SIZE];
 static uint8_t blueLUT[LUT_SIZE];
-static bool lutInitialized = false;
-
-// Color mapping
-inline uint32_t colorMap(Grid& grid, int i, int j,
-                         float maxCrystalMass, float maxDiffusiveMass) {
-    if (!lutInitialized) {
-        buildColorLUT(redLUT, greenLUT, blueLUT);
-        lutInitialized = true;
-    }
 
-    float value = 0.0f;
-    if (grid.isCrystal[i][j]) {
-        if (maxCrystalMass > 0.0f) {
-            float normalizedMass = grid.crystalMass[i][j] / maxCrystalMass;
-            value = std::pow(normalizedMass, 0.5f);
-        }
-    } else {
-        if (maxDiffusiveMass > 0.0f) {
-            // Keep vapor scaling the same: dark and subtle
-            float normalizedMass = grid.diffusiveMass[i][j] / maxDiffusiveMass;
-            value = -std::pow(normalizedMass, 1.5f);
-        }
+inline void ensureColorLUT() {
+    static const bool built = (buildColorLUT(redLUT, greenLUT, blueLUT), true);
+    (void)built;
+}
+
+// Crystal brightens with its mass, vapor stays dark and subtle. The value is
+// in [-1, 1], vapor below zero and crystal above.
+inline float colorValue(bool crystal, float mass, float maxCrystalMass, float maxDiffusiveMass) {
+    if (crystal) {
+        return maxCrystalMass > 0.0f ? std::pow(mass / maxCrystalMass, 0.5f) : 0.0f;
     }
+    return maxDiffusiveMass > 0.0f ? -std::pow(mass / maxDiffusiveMass, 1.5f) : 0.0f;
+}
 
+// LUT index of a value from colorValue
+inline int colorIndex(float value) {
     // Remap value from [-1,1] -> [0,1]
     float t = (value + 1.0f) * 0.5f;
     t = std::clamp(t, 0.0f, 1.0f);
+    return static_cast<int>(t * (LUT_SIZE - 1));
+}
 
-    int idx = static_cast<int>(t * (LUT_SIZE - 1));
+// ARGB color of a LUT index
+inline uint32_t colorOfIndex(int idx) {
+    ensureColorLUT();
     uint8_t r = redLUT[idx];
     uint8_t g = greenLUT[idx];
     uint8_t b = blueLUT[idx];
@@ -88,4 +84,86 @@ inline uint32_t colorMap(Grid& grid, int i, int j,
     return 0xFF000000 | (r << 16) | (g << 8) | b;
 }
 
-#endif // GG_COLORMAP_H
\ No newline at end of file
+// ARGB color of a value from colorValue
+inline uint32_t colorOfValue(float value) {
+    return colorOfIndex(colorIndex(value));
+}
+
+// Colors of one frame without pow. A mass divided by the frame's maximum
+// indexes a table of the colors of NORMALIZED_STEPS + 1 evenly spaced
+// normalized masses, one table for crystal and one for vapor. The tables
+// are built once; the nearest entry is at most one LUT step off colorValue.
+constexpr int NORMALIZED_STEPS = 4096;
+
+struct ColorTables {
+    uint32_t crystal[NORMALIZED_STEPS + 1];
+    uint32_t vapor[NORMALIZED_STEPS + 1];
+};
+
+inline const ColorTables& colorTables() {
+    static const ColorTables tables = []() {
+        ColorTables tables;
+        for (int k = 0; k <= NORMALIZED_STEPS; ++k) {
+            const float normalized = static_cast<float>(k) / NORMALIZED_STEPS;
+            tables.crystal[k] = colorOfValue(colorValue(true, normalized, 1.0f, 1.0f));
+            tables.vapor[k] = colorOfValue(colorValue(false, normalized, 1.0f, 1.0f));
+        }
+        return tables;
+    }();
+    return tables;
+}
+
+class ColorScale {
+    public:
+        ColorScale(float maxCrystalMass, float maxDiffusiveMass)
+            : tables(colorTables()),
+              crystalScale(maxCrystalMass > 0.0f ? NORMALIZED_STEPS / maxCrystalMass : 0.0f),
+              vaporScale(maxDiffusiveMass > 0.0f ? NORMALIZED_STEPS / maxDiffusiveMass : 0.0f) {}
+
+        // ARGB color of a cell
+        uint32_t operator()(bool crystal, float mass) const {
+            const float scaled = std::max(mass * (crystal ? crystalScale : vaporScale), 0.0f);
+            const int k = std::min(static_cast<int>(scaled + 0.5f), NORMALIZED_STEPS);
+            return crystal ? tables.crystal[k] : tables.vapor[k];
+        }
+    private:
+        const ColorTables& tables;
+        float crystalScale;
+        float vaporScale;
+};
+
+// Fills a run of pixels from per-cell colors: pixels[k] = cellColors[cells[k]]
+using ExpandPixelsKernel = void (*)(const uint32_t* cellColors, const uint32_t* cells, uint32_t* pixels, int count);
+
+inline void expandPixelsScalar(const uint32_t* cellColors, const uint32_t* cells, uint32_t* pixels, int count) {
+    for (int k = 0; k < count; ++k) {
+        pixels[k] = cellColors[cells[k]];
+    }
+}
+
+#ifdef GG_RUNTIME_AVX2
+// Compiled for AVX2 regardless of the build flags, only called after a CPU check
+__attribute__((target("avx2")))
+inline void expandPixelsAVX2(const uint32_t* cellColors, const uint32_t* cells, uint32_t* pixels, int count) {
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells + k));
+        const __m256i color = _mm256_i32gather_epi32(reinterpret_cast<const int*>(cellColors), index, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + k), color);
+    }
+    expandPixelsScalar(cellColors, cells + k, pixels + k, count - k);
+}
+#endif
+
+// Gathers where the CPU has them. Wasm SIMD and SSE have no gather, and
+// their scalar loop is as fast as emulating one.
+inline ExpandPixelsKernel selectExpandPixelsKernel() {
+#ifdef GG_RUNTIME_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return expandPixelsAVX2;
+    }
+#endif
+    return expandPixelsScalar;
+}
+
+#endif // GG_COLORMAP_H
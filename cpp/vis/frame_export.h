@@ -0,0 +1,336 @@
+#ifndef GG_FRAME_EXPORT_H
+#define GG_FRAME_EXPORT_H
+
+#include "../src/gg_model.h"
+#include "colormap.h"
+#include "hex_raster.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes frames of a growing snowflake to disk, as a PNG sequence or a Y4M
+// video, without SDL. capture() only samples the grid into one of a few
+// reusable frame buffers; coloring, encoding and writing happen on a
+// background thread, so stepping goes on while frames are written. When all
+// the buffers are waiting to be written, capture() waits for one, or with
+// dropWhenFull skips the frame.
+
+enum class FrameFormat {
+    PNG,    // path is a directory, frames are frame_000000.png, ...
+    Y4M     // path is a file, or "-" for stdout (to pipe into ffmpeg)
+};
+
+struct FrameExportSettings {
+    FrameFormat format = FrameFormat::PNG;
+    int size = 1000;            // Frames are size x size pixels
+    int framesPerSecond = 30;   // Y4M only
+    int ringSize = 4;           // Frame buffers
+    bool dropWhenFull = false;
+};
+
+namespace frame_detail {
+
+inline uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = []() {
+        std::vector<uint32_t> table(256);
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        return table;
+    }();
+    crc = ~crc;
+    for (size_t k = 0; k < size; ++k) {
+        crc = table[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    const uint8_t bytes[4] = {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)};
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+inline void appendChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    appendBigEndian(out, static_cast<uint32_t>(data.size()));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    appendBigEndian(out, crc32(out.data() + start, out.size() - start));
+}
+
+// 8-bit RGB PNG. The image data goes into stored (uncompressed) deflate
+// blocks, which keeps the encoder small and fast; recompress the frames
+// afterwards if size matters.
+inline void encodePNG(const std::vector<uint8_t>& rgb, int width, int height, std::vector<uint8_t>& out) {
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.assign(signature, signature + 8);
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.insert(header.end(), {8, 2, 0, 0, 0});   // 8 bit RGB, no interlace
+    appendChunk(out, "IHDR", header);
+
+    // zlib stream: rows with filter type 0, split into blocks of at most 64K
+    std::vector<uint8_t> raw;
+    raw.reserve(static_cast<size_t>(height) * (3 * width + 1));
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + static_cast<size_t>(y) * 3 * width,
+                   rgb.begin() + static_cast<size_t>(y + 1) * 3 * width);
+    }
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    for (size_t offset = 0; offset < raw.size(); offset += 65535) {
+        const uint16_t length = static_cast<uint16_t>(std::min<size_t>(65535, raw.size() - offset));
+        zlib.push_back(offset + length >= raw.size());
+        zlib.insert(zlib.end(), {uint8_t(length), uint8_t(length >> 8), uint8_t(~length), uint8_t(~length >> 8)});
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+    }
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(zlib, (b << 16) | a);
+    appendChunk(out, "IDAT", zlib);
+    appendChunk(out, "IEND", {});
+}
+
+// One Y4M frame, 4:4:4 with BT.601 limited range
+inline void encodeY4MFrame(const std::vector<uint8_t>& rgb, int width, int height, std::vector<uint8_t>& out) {
+    const size_t pixels = static_cast<size_t>(width) * height;
+    const char marker[] = "FRAME\n";
+    out.assign(marker, marker + 6);
+    out.resize(6 + 3 * pixels);
+    uint8_t* y = out.data() + 6;
+    uint8_t* u = y + pixels;
+    uint8_t* v = u + pixels;
+    for (size_t k = 0; k < pixels; ++k) {
+        const int r = rgb[3 * k], g = rgb[3 * k + 1], b = rgb[3 * k + 2];
+        y[k] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u[k] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v[k] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+} // namespace frame_detail
+
+class FrameExporter {
+    public:
+        // The frames show the whole grid of settings. Check error() to see
+        // whether the output could be opened.
+        FrameExporter(const ModelSettings& settings, const std::string& path, const FrameExportSettings& exportSettings);
+        ~FrameExporter();
+        // Writes the frames still waiting and closes the output. Returns
+        // false if any frame couldn't be written (see error()).
+        bool finish();
+        // Samples grid (the whole grid, see BasicModel::fullGrid) as the
+        // frame of the given step. Returns false if the frame was dropped.
+        template <typename Layout>
+        bool capture(const Layout& grid, uint64_t step);
+        uint64_t framesWritten() const;
+        uint64_t framesDropped() const;
+        std::string error() const;
+    private:
+        struct Frame {
+            uint64_t step;
+            float maxCrystalMass;
+            float maxDiffusiveMass;
+            // Per pixel: the crystal mass of a crystal cell, or minus the
+            // vapor of any other cell (so vapor always has the sign bit set)
+            std::vector<float> samples;
+        };
+
+        std::string path;
+        FrameExportSettings exportSettings;
+        std::vector<Point> pixelToHex;
+        FILE* video = nullptr;
+
+        std::vector<Frame> ring;
+        uint64_t captured = 0;  // Frames handed to the writer
+        uint64_t written = 0;   // Frames the writer is done with
+        uint64_t saved = 0;     // Of those, the ones that made it to disk
+        uint64_t dropped = 0;   // Frames capture() skipped
+        bool stopping = false;
+        std::string firstError;
+        mutable std::mutex mutex;
+        std::condition_variable frameReady;
+        std::condition_variable bufferFree;
+        std::thread writer;
+
+        void writeFrames();
+        bool writeFrame(const Frame&, std::vector<uint8_t>& rgb, std::vector<uint8_t>& encoded);
+};
+
+
+FrameExporter::FrameExporter(const ModelSettings& settings, const std::string& path,
+                             const FrameExportSettings& exportSettings)
+    : path(path), exportSettings(exportSettings) {
+    const int size = std::max(1, exportSettings.size);
+    this->exportSettings.size = size;
+    // The hexagon spans the frame from side to side
+    const float verticalDistance = static_cast<float>(size) / settings.gridSize * std::sqrt(3.0f) / 2.0f;
+    pixelToHex = mapPixelsToHexes(gridDomain(settings), settings.gridSize, size,
+                                  (2.0f / std::sqrt(3.0f)) * verticalDistance, verticalDistance);
+
+    if (exportSettings.format == FrameFormat::Y4M) {
+        video = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+        if (!video) {
+            firstError = "can't write " + path;
+        } else {
+            std::fprintf(video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", size, size,
+                         std::max(1, exportSettings.framesPerSecond));
+        }
+    }
+
+    ring.resize(std::max(1, exportSettings.ringSize));
+    for (auto& frame : ring) {
+        frame.samples.resize(pixelToHex.size());
+    }
+    writer = std::thread(&FrameExporter::writeFrames, this);
+}
+
+FrameExporter::~FrameExporter() {
+    finish();
+}
+
+bool FrameExporter::finish() {
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        frameReady.notify_one();
+        writer.join();
+
+        const bool closed = video == stdout ? std::fflush(video) == 0 : !video || std::fclose(video) == 0;
+        video = nullptr;
+        if (!closed && firstError.empty()) {
+            firstError = "can't write " + path;
+        }
+    }
+    return firstError.empty();
+}
+
+template <typename Layout>
+bool FrameExporter::capture(const Layout& grid, uint64_t step) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (captured - written == ring.size()) {
+            if (exportSettings.dropWhenFull) {
+                dropped++;
+                return false;
+            }
+            bufferFree.wait(lock, [&]() { return captured - written < ring.size(); });
+        }
+    }
+
+    // The writer is done with this buffer and won't touch it until captured
+    // moves past it
+    Frame& frame = ring[captured % ring.size()];
+    frame.step = step;
+    frame.maxCrystalMass = 0.0f;
+    frame.maxDiffusiveMass = 0.0f;
+    for (int i = 0; i < grid.domain.rows(); i++) {
+        for (int j = grid.domain[i].begin; j < grid.domain[i].end; j++) {
+            frame.maxCrystalMass = std::max(frame.maxCrystalMass, static_cast<float>(grid.crystalMassAt(i, j)));
+            frame.maxDiffusiveMass = std::max(frame.maxDiffusiveMass, static_cast<float>(grid.diffusiveMassAt(i, j)));
+        }
+    }
+    for (size_t k = 0; k < pixelToHex.size(); ++k) {
+        const auto [i, j] = pixelToHex[k];
+        frame.samples[k] = grid.isCrystalAt(i, j) ? static_cast<float>(grid.crystalMassAt(i, j))
+                                                  : -std::fabs(static_cast<float>(grid.diffusiveMassAt(i, j)));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        captured++;
+    }
+    frameReady.notify_one();
+    return true;
+}
+
+void FrameExporter::writeFrames() {
+    std::vector<uint8_t> rgb, encoded;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameReady.wait(lock, [&]() { return captured > written || stopping; });
+            if (captured == written) return;
+        }
+
+        // After a write error the remaining frames are only consumed
+        const Frame& frame = ring[written % ring.size()];
+        const bool ok = error().empty() && writeFrame(frame, rgb, encoded);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written++;
+            if (ok) saved++;
+        }
+        bufferFree.notify_one();
+    }
+}
+
+bool FrameExporter::writeFrame(const Frame& frame, std::vector<uint8_t>& rgb, std::vector<uint8_t>& encoded) {
+    const int size = exportSettings.size;
+    const ColorScale colorOf(frame.maxCrystalMass, frame.maxDiffusiveMass);
+    rgb.resize(3 * frame.samples.size());
+    for (size_t k = 0; k < frame.samples.size(); ++k) {
+        const float sample = frame.samples[k];
+        const bool crystal = !std::signbit(sample);
+        const uint32_t color = colorOf(crystal, crystal ? sample : -sample);
+        rgb[3 * k] = static_cast<uint8_t>(color >> 16);
+        rgb[3 * k + 1] = static_cast<uint8_t>(color >> 8);
+        rgb[3 * k + 2] = static_cast<uint8_t>(color);
+    }
+
+    std::string target = path;
+    FILE* file = video;
+    if (exportSettings.format == FrameFormat::PNG) {
+        frame_detail::encodePNG(rgb, size, size, encoded);
+        char name[32];
+        std::snprintf(name, sizeof(name), "/frame_%06llu.png", static_cast<unsigned long long>(written));
+        target += name;
+        file = std::fopen(target.c_str(), "wb");
+    } else {
+        frame_detail::encodeY4MFrame(rgb, size, size, encoded);
+    }
+
+    bool ok = file && std::fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    if (file && file != video) {
+        ok = std::fclose(file) == 0 && ok;
+    }
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        firstError = "can't write " + target;
+    }
+    return ok;
+}
+
+uint64_t FrameExporter::framesWritten() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return saved;
+}
+
+uint64_t FrameExporter::framesDropped() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped;
+}
+
+std::string FrameExporter::error() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return firstError;
+}
+
+#endif // GG_FRAME_EXPORT_H
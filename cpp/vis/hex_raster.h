@@ -0,0 +1,67 @@
+#ifndef GG_HEX_RASTER_H
+#define GG_HEX_RASTER_H
+
+#include "../src/gg_model.h"
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Nearest hex cell to pixel (x, y) of an image whose middle shows the middle
+// of the grid, with hex centers the given distances apart
+inline Point nearestHex(float x, float y, int imageMiddle, int gridMiddle,
+                        float horizontalDistance, float verticalDistance) {
+    // Convert pixel coordinates to hex grid coordinates (floating point)
+    float rowF = gridMiddle + (y - imageMiddle) / verticalDistance;
+    float colF = gridMiddle + (x - imageMiddle) / horizontalDistance
+                          + (rowF - gridMiddle) * 0.5f;
+
+    // Check 4 candidate hex cells around this position
+    int r0 = static_cast<int>(std::floor(rowF));
+    int c0 = static_cast<int>(std::floor(colF));
+
+    // Find closest hex center
+    Point nearest{r0, c0};
+    float minDist = std::numeric_limits<float>::max();
+    for (int dr = 0; dr <= 1; dr++) {
+        for (int dc = 0; dc <= 1; dc++) {
+            int testRow = r0 + dr;
+            int testCol = c0 + dc;
+            float hx = imageMiddle + (testCol - gridMiddle - (testRow - gridMiddle) * 0.5f) * horizontalDistance;
+            float hy = imageMiddle + (testRow - gridMiddle) * verticalDistance;
+            float dist = (x - hx) * (x - hx) + (y - hy) * (y - hy);
+            if (dist < minDist) {
+                minDist = dist;
+                nearest = Point{testRow, testCol};
+            }
+        }
+    }
+    return nearest;
+}
+
+// The cell shown off the grid: its first cell, a far-field corner
+inline Point outsideCell(const Domain& domain) {
+    for (int i = 0; i < domain.rows(); ++i) {
+        if (domain[i].begin < domain[i].end) {
+            return Point{i, domain[i].begin};
+        }
+    }
+    return Point{0, 0};
+}
+
+// The cell each pixel of a size x size image shows, row by row (see
+// outsideCell for pixels off the grid)
+inline std::vector<Point> mapPixelsToHexes(const Domain& domain, int gridSize, int size,
+                                           float horizontalDistance, float verticalDistance) {
+    const Point outside = outsideCell(domain);
+
+    std::vector<Point> pixelToHex(static_cast<size_t>(size) * size);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            const Point hex = nearestHex(x, y, size / 2, gridSize / 2, horizontalDistance, verticalDistance);
+            pixelToHex[static_cast<size_t>(y) * size + x] = domain.contains(hex.first, hex.second) ? hex : outside;
+        }
+    }
+    return pixelToHex;
+}
+
+#endif // GG_HEX_RASTER_H
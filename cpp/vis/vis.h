@@ -5,8 +5,10 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_events.h>
 #include <algorithm>
+#include <climits>
 #include <cstdint>
 #include "colormap.h"
+#include "hex_raster.h"
 
 
 class Visualizer {
@@ -14,18 +16,22 @@ class Visualizer {
         Visualizer(ModelSettings& settings, int windowSize);
         ~Visualizer();
         bool init();
-        void draw(Grid&);
+        template <typename Layout>
+        void draw(const Layout&);
+        // Draws only what may have changed: cells outside active hold the far
+        // field (see BasicModel::activeExtent)
+        template <typename Layout>
+        void draw(const Layout&, const Extent& active);
         int getWindowSize();
         void resizeWindow(int newWindowSize);
         void resizeGrid(int newGridSize);
         void changeDrawingScale(float delta);
+        TraceRing<FrameRecord> frameTrace;  // Filled in with -DGG_TRACE (see trace.h)
     private:
         int windowSize;
         float hexHorizontalDistance;
         float hexVerticalDistance;
         float drawingScale;
-        int gridMiddle;
-        int windowMiddle;
 
         ModelSettings* settings;
 
@@ -33,9 +39,32 @@ class Visualizer {
         SDL_Renderer* renderer;
         SDL_Texture* texture;
         uint32_t* pixels = nullptr;
-        std::vector<Point> pixelToHex; // Cache: maps each pixel to its nearest hex cell
+        // Cache: each pixel's nearest hex cell, as row * gridSize + col
+        std::vector<uint32_t> pixelCells;
+        ExpandPixelsKernel expandPixels = selectExpandPixelsKernel();
 
-        void getHexIndex(float x, float y, int& row, int& col);
+        // Incremental drawing. Every cell keeps the color it was last drawn
+        // with; a cell whose color changes marks its block of cells dirty, and
+        // only the pixel tiles showing a dirty block are recolored and uploaded.
+        static constexpr int TILE_SIZE = 32;    // Pixels
+        static constexpr int BLOCK_SIZE = 8;    // Cells
+        struct TileCells {
+            Extent cells;       // Empty if the tile is all off the grid
+            bool showsOutside;  // Some pixels are off the grid
+        };
+        int tilesPerRow = 0;
+        int blocksPerRow = 0;
+        std::vector<TileCells> tileCells;
+        Point outside;                      // The cell shown off the grid
+        std::vector<uint32_t> cellColors;   // ARGB, row by row over the whole grid
+        std::vector<uint8_t> dirtyBlocks;
+        bool redrawAll = true;              // Set whenever the mapping changes
+        Extent drawnExtent;                 // What draw was told was active
+        float drawnMaxC = 0.0f, drawnMaxD = 0.0f, drawnAmbient = 0.0f;
+        uint64_t framesDrawn = 0;
+
+        void buildPixelToHex();
+        bool isTileDirty(const TileCells&) const;
 };
 
 
@@ -52,8 +81,6 @@ Visualizer::Visualizer(ModelSettings& settings, int windowSize)
     drawingScale = 1.0f;
     hexVerticalDistance = windowSize / settings.gridSize * sqrt(3.0f) / 2.0f * drawingScale;
     hexHorizontalDistance = (2.0f / sqrt(3.0f)) * hexVerticalDistance;
-    gridMiddle = settings.gridSize / 2;
-    windowMiddle = windowSize / 2;
     init();
 }
 
@@ -72,21 +99,54 @@ bool Visualizer::init() {
     pixels = new uint32_t[windowSize * windowSize];
 
     // Pre-compute which hex each pixel belongs to
-    pixelToHex = std::vector<Point>(windowSize * windowSize, Point{0, 0});
-    int row, col;
+    buildPixelToHex();
+
+    return true;
+}
+
+void Visualizer::buildPixelToHex() {
+    const Domain domain = gridDomain(*settings);
+    const std::vector<Point> pixelToHex = mapPixelsToHexes(domain, settings->gridSize, windowSize,
+                                                           hexHorizontalDistance, hexVerticalDistance);
+    pixelCells.resize(pixelToHex.size());
+    for (size_t k = 0; k < pixelToHex.size(); ++k) {
+        pixelCells[k] = static_cast<uint32_t>(pixelToHex[k].first * settings->gridSize + pixelToHex[k].second);
+    }
+
+    // The cells each tile shows, besides the one standing in for off the grid
+    outside = outsideCell(domain);
+    tilesPerRow = (windowSize + TILE_SIZE - 1) / TILE_SIZE;
+    tileCells.assign(tilesPerRow * tilesPerRow, TileCells{{INT_MAX, INT_MIN, INT_MAX, INT_MIN}, false});
     for (int y = 0; y < windowSize; ++y) {
         for (int x = 0; x < windowSize; ++x) {
-            getHexIndex(x, y, row, col);
-            if (row < 0 || row >= settings->gridSize || col < 0 || col >= settings->gridSize) {
-                pixelToHex[y * windowSize + x] = Point{0 ,0};
-            } 
-            else {
-                pixelToHex[y * windowSize + x] = Point{row, col};
+            const Point p = pixelToHex[y * windowSize + x];
+            TileCells& tile = tileCells[(y / TILE_SIZE) * tilesPerRow + x / TILE_SIZE];
+            if (p == outside) {
+                tile.showsOutside = true;
+                continue;
             }
+            tile.cells.minRow = std::min(tile.cells.minRow, p.first);
+            tile.cells.maxRow = std::max(tile.cells.maxRow, p.first);
+            tile.cells.minCol = std::min(tile.cells.minCol, p.second);
+            tile.cells.maxCol = std::max(tile.cells.maxCol, p.second);
         }
     }
 
-    return true;
+    blocksPerRow = (settings->gridSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    dirtyBlocks.assign(blocksPerRow * blocksPerRow, 0);
+    redrawAll = true;
+}
+
+bool Visualizer::isTileDirty(const TileCells& tile) const {
+    if (tile.showsOutside && dirtyBlocks[(outside.first / BLOCK_SIZE) * blocksPerRow + outside.second / BLOCK_SIZE]) {
+        return true;
+    }
+    for (int bi = tile.cells.minRow / BLOCK_SIZE; bi <= tile.cells.maxRow / BLOCK_SIZE; ++bi) {
+        for (int bj = tile.cells.minCol / BLOCK_SIZE; bj <= tile.cells.maxCol / BLOCK_SIZE; ++bj) {
+            if (dirtyBlocks[bi * blocksPerRow + bj]) return true;
+        }
+    }
+    return false;
 }
 
 int Visualizer::getWindowSize() {
@@ -95,7 +155,6 @@ int Visualizer::getWindowSize() {
 
 void Visualizer::resizeWindow(int newWindowSize) {
     windowSize = newWindowSize;
-    windowMiddle = windowSize / 2;
     
     // Recalculate hex spacing
     hexVerticalDistance = windowSize / settings->gridSize * sqrt(3.0f) / 2.0f * drawingScale;
@@ -110,97 +169,124 @@ void Visualizer::resizeWindow(int newWindowSize) {
     pixels = new uint32_t[windowSize * windowSize];
     
     // Rebuild pixel-to-hex mapping
-    pixelToHex.resize(windowSize * windowSize);
-    int row, col;
-    for (int y = 0; y < windowSize; ++y) {
-        for (int x = 0; x < windowSize; ++x) {
-            getHexIndex(x, y, row, col);
-            if (row < 0 || row >= settings->gridSize || col < 0 || col >= settings->gridSize) {
-                pixelToHex[y * windowSize + x] = Point{0, 0};
-            } else {
-                pixelToHex[y * windowSize + x] = Point{row, col};
-            }
-        }
-    }
+    buildPixelToHex();
 }
 
 void Visualizer::resizeGrid(int newGridSize) {
     settings->gridSize = newGridSize;
-    gridMiddle = settings->gridSize / 2;
 
     // Recalculate hex spacing
     hexVerticalDistance = windowSize / settings->gridSize * sqrt(3.0f) / 2.0f * drawingScale;
     hexHorizontalDistance = (2.0f * sqrt(3.0f) / 3.0f) * hexVerticalDistance;
 
     // Rebuild pixel-to-hex mapping
-    int row, col;
-    for (int y = 0; y < windowSize; ++y) {
-        for (int x = 0; x < windowSize; ++x) {
-            getHexIndex(x, y, row, col);
-            if (row < 0 || row >= settings->gridSize || col < 0 || col >= settings->gridSize) {
-                pixelToHex[y * windowSize + x] = Point{0, 0};
-            } else {
-                pixelToHex[y * windowSize + x] = Point{row, col};
-            }
-        }
-    }
+    buildPixelToHex();
 }
 
 
-void Visualizer::getHexIndex(float x, float y, int& row, int& col) {
-    // Convert pixel coordinates to hex grid coordinates (floating point)
-    float rowF = gridMiddle + (y - windowMiddle) / hexVerticalDistance;
-    float colF = gridMiddle + (x - windowMiddle) / hexHorizontalDistance
-                          + (rowF - gridMiddle) * 0.5f;
+template <typename Layout>
+void Visualizer::draw(const Layout& grid) {
+    const int N = grid.domain.rows();
+    draw(grid, Extent{0, N - 1, 0, N - 1});
+}
 
-    // Check 4 candidate hex cells around this position
-    int r0 = static_cast<int>(std::floor(rowF));
-    int c0 = static_cast<int>(std::floor(colF));
-    
-    // Find closest hex center
-    float minDist = std::numeric_limits<float>::max();
-    for (int dr = 0; dr <= 1; dr++) {
-        for (int dc = 0; dc <= 1; dc++) {
-            int testRow = r0 + dr;
-            int testCol = c0 + dc;
-            float hx = windowMiddle + (testCol - gridMiddle - (testRow - gridMiddle) * 0.5f) * hexHorizontalDistance;
-            float hy = windowMiddle + (testRow - gridMiddle) * hexVerticalDistance;
-            float dist = (x - hx) * (x - hx) + (y - hy) * (y - hy);
-            if (dist < minDist) {
-                minDist = dist;
-                row = testRow;
-                col = testCol;
-            }
+
+template <typename Layout>
+void Visualizer::draw(const Layout& grid, const Extent& active) {
+    #ifdef GG_TRACE
+    const double traceStart = traceMicros();
+    #endif
+    const int N = grid.domain.rows();
+    const Domain& domain = grid.domain;
+    const Extent region = {std::max(active.minRow, 0), std::min(active.maxRow, N - 1),
+                           std::max(active.minCol, 0), std::min(active.maxCol, N - 1)};
+
+    // Find max values for normalization. Every cell outside the region holds
+    // the same far-field vapor and nothing else, so one of them will do.
+    float maxC = 0.0f, maxD = 0.0f, ambient = 0.0f;
+    for (int i = 0; i < N; i++) {
+        if (domain[i].begin >= domain[i].end) continue;
+        const bool rowOutside = i < region.minRow || i > region.maxRow;
+        if (rowOutside || domain[i].begin < region.minCol || domain[i].end - 1 > region.maxCol) {
+            const int j = rowOutside || domain[i].begin < region.minCol ? domain[i].begin : domain[i].end - 1;
+            ambient = grid.diffusiveMassAt(i, j);
+            maxD = ambient;
+            break;
+        }
+    }
+    for (int i = region.minRow; i <= region.maxRow; i++) {
+        const int end = std::min(domain[i].end, region.maxCol + 1);
+        for (int j = std::max(domain[i].begin, region.minCol); j < end; j++) {
+            if (grid.crystalMassAt(i, j) > maxC) maxC = grid.crystalMassAt(i, j);
+            if (grid.diffusiveMassAt(i, j) > maxD) maxD = grid.diffusiveMassAt(i, j);
         }
     }
-}
-
 
-void Visualizer::draw(Grid& grid) {
-    // Find max values for normalization
-    float maxC = 0.0f, maxD = 0.0f;
-    for (int i = 0; i < settings->gridSize; i++) {
-        for (int j = 0; j < settings->gridSize; j++) {
-            if (grid.crystalMass[i][j] > maxC) maxC = grid.crystalMass[i][j];
-            if (grid.diffusiveMass[i][j] > maxD) maxD = grid.diffusiveMass[i][j];
+    // New maxima or far field recolor everything, otherwise only cells that
+    // are active now or were at the last draw can have changed
+    const size_t cells = static_cast<size_t>(N) * N;
+    if (cellColors.size() != cells || static_cast<int>(dirtyBlocks.size()) != blocksPerRow * blocksPerRow ||
+        blocksPerRow * BLOCK_SIZE < N || maxC != drawnMaxC || maxD != drawnMaxD || ambient != drawnAmbient) {
+        cellColors.resize(cells);
+        redrawAll = true;
+    }
+    const Extent scan = redrawAll ? Extent{0, N - 1, 0, N - 1}
+                                  : Extent{std::min(region.minRow, drawnExtent.minRow), std::max(region.maxRow, drawnExtent.maxRow),
+                                           std::min(region.minCol, drawnExtent.minCol), std::max(region.maxCol, drawnExtent.maxCol)};
+    const ColorScale colorOf(maxC, maxD);
+    for (int i = scan.minRow; i <= scan.maxRow; i++) {
+        const int end = std::min(domain[i].end, scan.maxCol + 1);
+        for (int j = std::max(domain[i].begin, scan.minCol); j < end; j++) {
+            const bool crystal = grid.isCrystalAt(i, j);
+            const uint32_t color = colorOf(crystal, crystal ? grid.crystalMassAt(i, j) : grid.diffusiveMassAt(i, j));
+            uint32_t& drawn = cellColors[static_cast<size_t>(i) * N + j];
+            if (drawn != color || redrawAll) {
+                drawn = color;
+                dirtyBlocks[(i / BLOCK_SIZE) * blocksPerRow + j / BLOCK_SIZE] = 1;
+            }
         }
     }
 
-    // Color each pixel based on its hex cell's values
-    uint32_t color;
-    int row, col;
-    Point p;
-    for (int x = 0; x < windowSize; x++) {
-        for (int y = 0; y < windowSize; y++) {
-            p = pixelToHex[y * windowSize + x];
-            pixels[y * windowSize + x] = colorMap(grid, p.first, p.second, maxC, maxD);
+    // Recolor each run of dirty tiles along a tile row, a pixel row at a
+    // time, and upload it as one rectangle
+    for (int ty = 0; ty < tilesPerRow; ty++) {
+        const int y0 = ty * TILE_SIZE;
+        const int y1 = std::min(y0 + TILE_SIZE, windowSize);
+        int runStart = -1;
+        for (int tx = 0; tx <= tilesPerRow; tx++) {
+            const bool dirty = tx < tilesPerRow && (redrawAll || isTileDirty(tileCells[ty * tilesPerRow + tx]));
+            if (dirty) {
+                if (runStart < 0) runStart = tx;
+                continue;
+            }
+            if (runStart < 0) continue;
+
+            const int x0 = runStart * TILE_SIZE;
+            const int x1 = std::min(tx * TILE_SIZE, windowSize);
+            for (int y = y0; y < y1; y++) {
+                expandPixels(cellColors.data(), pixelCells.data() + y * windowSize + x0, pixels + y * windowSize + x0, x1 - x0);
+            }
+            const SDL_Rect rect = {x0, y0, x1 - x0, y1 - y0};
+            SDL_UpdateTexture(texture, &rect, pixels + y0 * windowSize + x0, windowSize * sizeof(uint32_t));
+            runStart = -1;
         }
     }
 
+    std::fill(dirtyBlocks.begin(), dirtyBlocks.end(), 0);
+    redrawAll = false;
+    drawnExtent = region;
+    drawnMaxC = maxC;
+    drawnMaxD = maxD;
+    drawnAmbient = ambient;
+
     // Render to screen
-    SDL_UpdateTexture(texture, NULL, pixels, windowSize * sizeof(uint32_t));
     SDL_RenderTexture(renderer, texture, NULL, NULL);
     SDL_RenderPresent(renderer);
+
+    #ifdef GG_TRACE
+    frameTrace.push(FrameRecord{framesDrawn, traceStart, static_cast<float>((traceMicros() - traceStart) * 1e-3)});
+    #endif
+    framesDrawn++;
 }
 
 
@@ -211,16 +297,6 @@ void Visualizer::changeDrawingScale(float delta) {
     hexHorizontalDistance = (2.0f / sqrt(3.0f)) * hexVerticalDistance;
 
     // Rebuild pixel-to-hex mapping
-    int row, col;
-    for (int y = 0; y < windowSize; ++y) {
-        for (int x = 0; x < windowSize; ++x) {
-            getHexIndex(x, y, row, col);
-            if (row < 0 || row >= settings->gridSize || col < 0 || col >= settings->gridSize) {
-                pixelToHex[y * windowSize + x] = Point{settings->gridSize-1, 0};
-            } else {
-                pixelToHex[y * windowSize + x] = Point{row, col};
-            }
-        }
-    }
+    buildPixelToHex();
 }
 #endif // GG_VIS_H
\ No newline at end of file
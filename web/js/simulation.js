@@ -13,10 +13,33 @@ const rhoInput = $("#rho");
 const rhoOutput = $("#rho-output");
 const thetaInput = $("#theta");
 const thetaOutput = $("#theta-output");
+const sigmaInput = $("#sigma");
+const sigmaOutput = $("#sigma-output");
 const gridSizeInput = $("#grid-size");
 const gridSizeOutput = $("#grid-size-output");
 const iterationsPerFrameInput = $("#iterations-per-frame");
 const iterationsPerFrameOutput = $("#iterations-per-frame-output");
+const frameBudgetInput = $("#frame-budget");
+const frameBudgetOutput = $("#frame-budget-output");
+const stepsPerSecondOutput = $("#steps-per-second");
+const perfOverlay = $("#perf-overlay");
+
+// Means over the last 60 steps and frames, from builds with -DGG_TRACE
+function update_perf_overlay() {
+    if (!Module.get_trace_enabled()) return;
+
+    const row = (name, value) => `<div class="flex justify-between"><span>${name}</span><span>${value}</span></div>`;
+    let rows = row("step", Module.get_trace_step_ms(60).toFixed(3) + " ms");
+    for (let phase = 0; phase < Module.get_phase_count(); phase++) {
+        const ms = Module.get_trace_phase_ms(phase, 60);
+        if (ms > 0) rows += row("&nbsp;&nbsp;" + Module.get_phase_name(phase), ms.toFixed(3) + " ms");
+    }
+    rows += row("cells visited", Math.round(Module.get_trace_cells_visited(60)));
+    rows += row("attachments", Module.get_trace_attachments(60).toFixed(1));
+    rows += row("render", Module.get_trace_render_ms(60).toFixed(2) + " ms");
+    perfOverlay.html(rows);
+    perfOverlay.removeClass("hidden");
+}
 
 function reset() {
     Module.reset();
@@ -52,6 +75,11 @@ function set_theta(theta) {
     Module.set_theta(parseFloat(theta));
 }
 
+function set_sigma(sigma) {
+    sigmaOutput.text(sigma);
+    Module.set_sigma(parseFloat(sigma));
+}
+
 function play_pause() {
     isPaused = !isPaused;
     playPauseButton.text(isPaused ? "play_arrow" : "pause");
@@ -64,6 +92,11 @@ function set_iterations_per_frame(iterations) {
     Module.set_iterations_per_frame(parseInt(iterations));
 }
 
+function set_frame_budget(ms) {
+    frameBudgetOutput.text(ms);
+    Module.set_frame_budget(parseFloat(ms));
+}
+
 function set_grid_size(size) {
     gridSizeOutput.text(size);
     Module.set_grid_size(parseInt(size));
@@ -101,6 +134,10 @@ function applyPreset(index) {
     thetaInput.val(Module.get_current_theta().toFixed(4));
     thetaOutput.text(Module.get_current_theta().toFixed(4));
     
+    sigmaInput.value = Module.get_current_sigma().toFixed(5);
+    sigmaInput.val(Module.get_current_sigma().toFixed(5));
+    sigmaOutput.text(Module.get_current_sigma().toFixed(5));
+    
     gridSizeInput.value = Module.get_current_grid_size();
     gridSizeInput.val(Module.get_current_grid_size());
     gridSizeOutput.text(Module.get_current_grid_size());
@@ -166,10 +203,23 @@ Module.onRuntimeInitialized = () => {
     thetaInput.val( "0.025" );
     set_theta( "0.025" );
 
+    sigmaInput.value = "0";
+    sigmaInput.val( "0" );
+    set_sigma( "0" );
+
     iterationsPerFrameInput.value = "1";
     iterationsPerFrameInput.val( "1" );
     set_iterations_per_frame( "1" );
 
+    frameBudgetInput.value = "12";
+    frameBudgetInput.val( "12" );
+    set_frame_budget( "12" );
+
+    setInterval(() => {
+        stepsPerSecondOutput.text(Math.round(Module.get_steps_per_second()));
+        update_perf_overlay();
+    }, 500);
+
     gridSizeInput.value = "400";
     gridSizeInput.val( "400" );
     set_grid_size( "400" );